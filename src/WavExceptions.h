@@ -17,6 +17,10 @@ class IO_Exception : public WavException {
 public:
 	IO_Exception(const std::string& filename) : WavException("File " + filename + " can't be read.\n") {};
 };
+class Write_Exception : public WavException {
+public:
+	Write_Exception(const std::string& filename) : WavException("File " + filename + " can't be written.\n") {};
+};
 class Format_Exception : public WavException {
 public:
 	Format_Exception(const std::string& msg) : WavException(msg) {};
@@ -28,4 +32,8 @@ public:
 class Parameters_Exception : public WavException {
 public:
 	Parameters_Exception(const std::string& msg) : WavException(msg) {};
+};
+class Memory_Exception : public WavException {
+public:
+	Memory_Exception(const std::string& msg) : WavException(msg) {};
 };
\ No newline at end of file
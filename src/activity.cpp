@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "activity.h"
+#include "WavExceptions.h"
+
+float BlockEnergy(const short* data, size_t count)
+{
+	size_t i = 0;
+	float sum = 0.0f;
+#if defined(__SSE2__)
+	__m128 acc = _mm_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+		// Sign-extend 8 shorts to two vectors of 4 ints, then square as floats.
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+		acc = _mm_add_ps(acc, _mm_mul_ps(lo, lo));
+		acc = _mm_add_ps(acc, _mm_mul_ps(hi, hi));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+	for (; i < count; i++) {
+		float v = data[i];
+		sum += v * v;
+	}
+	return sum;
+}
+
+std::vector<ActivitySegment> DetectActivity(const std::vector<std::vector<short>>& channels_data,
+	int sample_rate, const ActivityParams& params)
+{
+	if (channels_data.empty()) {
+		throw Format_Exception("Channel count can't be fewer than 1");
+	}
+	if (params.block_frames == 0 || params.close_db > params.open_db) {
+		throw Parameters_Exception("Bad activity detection parameters.\n");
+	}
+
+	size_t frames = channels_data[0].size();
+	size_t chan_count = channels_data.size();
+	size_t hold_blocks = (size_t)(params.hold_seconds * sample_rate / params.block_frames);
+	// Full scale energy of one sample, levels are measured relative to it.
+	const float full_scale = 32768.0f * 32768.0f;
+
+	std::vector<ActivitySegment> segments;
+	bool active = false;
+	size_t hold_left = 0;
+	ActivitySegment current = { 0, 0 };
+
+	for (size_t begin = 0; begin < frames; begin += params.block_frames) {
+		size_t count = std::min(params.block_frames, frames - begin);
+
+		float energy = 0.0f;
+		for (size_t ch = 0; ch < chan_count; ch++) {
+			energy += BlockEnergy(channels_data[ch].data() + begin, count);
+		}
+		float level_db = 10.0f * log10f(energy / (count * chan_count * full_scale) + 1e-12f);
+
+		if (!active) {
+			if (level_db >= params.open_db) {
+				active = true;
+				hold_left = hold_blocks;
+				current.begin = begin;
+			}
+		}
+		else if (level_db >= params.close_db) {
+			hold_left = hold_blocks;
+		}
+		else if (hold_left > 0) {
+			hold_left--;
+		}
+		else {
+			active = false;
+			current.end = begin;
+			segments.push_back(current);
+		}
+	}
+	if (active) {
+		current.end = frames;
+		segments.push_back(current);
+	}
+	return segments;
+}
+
+bool IsRangeActive(const std::vector<ActivitySegment>& segments, size_t begin, size_t end)
+{
+	// Binary search for the first segment that ends after 'begin'.
+	size_t lo = 0, hi = segments.size();
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (segments[mid].end <= begin) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo < segments.size() && segments[lo].begin < end;
+}
+
+std::string SegmentsToJson(const std::vector<ActivitySegment>& segments, int sample_rate)
+{
+	std::ostringstream out;
+	out << "{\n  \"sample_rate\": " << sample_rate << ",\n  \"segments\": [";
+	for (size_t i = 0; i < segments.size(); i++) {
+		out << (i ? ",\n" : "\n") << "    { \"begin\": " << segments[i].begin
+			<< ", \"end\": " << segments[i].end
+			<< ", \"begin_seconds\": " << (double)segments[i].begin / sample_rate
+			<< ", \"end_seconds\": " << (double)segments[i].end / sample_rate << " }";
+	}
+	out << (segments.empty() ? "]\n}\n" : "\n  ]\n}\n");
+	return out.str();
+}
+
+void SaveSegmentsJson(const std::vector<ActivitySegment>& segments, int sample_rate, const std::string& filename)
+{
+	FILE* jf = fopen(filename.c_str(), "w");
+	if (jf == NULL) {
+		throw Write_Exception(filename);
+	}
+	std::string json = SegmentsToJson(segments, sample_rate);
+	size_t written = fwrite(json.data(), 1, json.size(), jf);
+	fclose(jf);
+	if (written != json.size()) {
+		throw Write_Exception(filename);
+	}
+}
+
+// Number that follows the first "key": at or after 'pos'; 'pos' is moved past it.
+static bool ReadJsonNumber(const std::string& json, const char* key, size_t& pos, double& value)
+{
+	pos = json.find(std::string("\"") + key + "\"", pos);
+	if (pos == std::string::npos) {
+		return false;
+	}
+	pos = json.find(':', pos);
+	if (pos == std::string::npos) {
+		return false;
+	}
+	const char* start = json.c_str() + pos + 1;
+	char* stop = NULL;
+	value = strtod(start, &stop);
+	pos += 1 + (stop - start);
+	return stop != start;
+}
+
+std::vector<ActivitySegment> LoadSegmentsJson(const std::string& filename, int sample_rate)
+{
+	FILE* jf = fopen(filename.c_str(), "r");
+	if (jf == NULL) {
+		throw IO_Exception(filename);
+	}
+	std::string json;
+	char buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), jf)) > 0) {
+		json.append(buffer, got);
+	}
+	fclose(jf);
+
+	size_t pos = 0;
+	double saved_rate = 0.0;
+	if (!ReadJsonNumber(json, "sample_rate", pos, saved_rate) || saved_rate < 1.0) {
+		throw Format_Exception("No sample rate in " + filename + "\n");
+	}
+	pos = json.find("\"segments\"", pos);
+	if (pos == std::string::npos) {
+		throw Format_Exception("No segments in " + filename + "\n");
+	}
+	double scale = sample_rate / saved_rate;
+	std::vector<ActivitySegment> segments;
+	double begin, end, last_end = 0.0;
+	while (ReadJsonNumber(json, "begin", pos, begin)) {
+		if (!ReadJsonNumber(json, "end", pos, end)) {
+			throw Format_Exception("Segment without an end in " + filename + "\n");
+		}
+		// IsRangeActive binary-searches, so the segments must be sorted and disjoint.
+		if (begin < last_end || begin >= end) {
+			throw Format_Exception("Segments in " + filename + " are not sorted ranges\n");
+		}
+		last_end = end;
+		ActivitySegment segment = { (size_t)floor(begin * scale), (size_t)ceil(end * scale) };
+		// Rounding outwards can make neighbours touch after a rate change.
+		if (!segments.empty() && segment.begin <= segments.back().end) {
+			segments.back().end = segment.end;
+		}
+		else {
+			segments.push_back(segment);
+		}
+	}
+	return segments;
+}
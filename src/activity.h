@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Half-open range of frames [begin, end) that contains audible signal.
+struct ActivitySegment {
+	size_t begin;
+	size_t end;
+};
+
+struct ActivityParams {
+	// Block becomes active when its RMS level rises above open_db (dBFS)
+	// and inactive again only after it falls below close_db.
+	float open_db = -45.0f;
+	float close_db = -50.0f;
+	// How long a segment stays open after the level dropped below close_db.
+	double hold_seconds = 0.25;
+	// Analysis block length in frames.
+	size_t block_frames = 512;
+};
+
+// Scans planar 16-bit PCM and returns active segments in frames.
+std::vector<ActivitySegment> DetectActivity(const std::vector<std::vector<short>>& channels_data,
+	int sample_rate, const ActivityParams& params);
+
+// Sum of squares of 'count' samples starting at 'data'. Vectorized with SSE2 when available.
+float BlockEnergy(const short* data, size_t count);
+
+// True if frames [begin, end) overlap any of the sorted 'segments'.
+// Lets block-based readers skip silent blocks without touching their samples.
+bool IsRangeActive(const std::vector<ActivitySegment>& segments, size_t begin, size_t end);
+
+std::string SegmentsToJson(const std::vector<ActivitySegment>& segments, int sample_rate);
+void SaveSegmentsJson(const std::vector<ActivitySegment>& segments, int sample_rate, const std::string& filename);
+// Reads a file written by SaveSegmentsJson. Segments saved at another rate are converted to
+// 'sample_rate', rounding outwards so no active frame is lost.
+std::vector<ActivitySegment> LoadSegmentsJson(const std::string& filename, int sample_rate);
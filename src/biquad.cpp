@@ -0,0 +1,155 @@
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "biquad.h"
+
+// Thin wrappers so the filter loop is written once for every vector width.
+#if defined(__AVX__)
+static const size_t LANE_WIDTH = 8;
+typedef __m256 lane_t;
+static inline lane_t vload(const float* p) { return _mm256_loadu_ps(p); }
+static inline void vstore(float* p, lane_t v) { _mm256_storeu_ps(p, v); }
+static inline lane_t vadd(lane_t a, lane_t b) { return _mm256_add_ps(a, b); }
+static inline lane_t vsub(lane_t a, lane_t b) { return _mm256_sub_ps(a, b); }
+static inline lane_t vmul(lane_t a, lane_t b) { return _mm256_mul_ps(a, b); }
+#elif defined(__SSE__)
+static const size_t LANE_WIDTH = 4;
+typedef __m128 lane_t;
+static inline lane_t vload(const float* p) { return _mm_loadu_ps(p); }
+static inline void vstore(float* p, lane_t v) { _mm_storeu_ps(p, v); }
+static inline lane_t vadd(lane_t a, lane_t b) { return _mm_add_ps(a, b); }
+static inline lane_t vsub(lane_t a, lane_t b) { return _mm_sub_ps(a, b); }
+static inline lane_t vmul(lane_t a, lane_t b) { return _mm_mul_ps(a, b); }
+#else
+static const size_t LANE_WIDTH = 1;
+typedef float lane_t;
+static inline lane_t vload(const float* p) { return *p; }
+static inline void vstore(float* p, lane_t v) { *p = v; }
+static inline lane_t vadd(lane_t a, lane_t b) { return a + b; }
+static inline lane_t vsub(lane_t a, lane_t b) { return a - b; }
+static inline lane_t vmul(lane_t a, lane_t b) { return a * b; }
+#endif
+
+static const double PI = 3.14159265358979323846;
+
+static void CheckFrequency(int sample_rate, double freq, double q) {
+	if (sample_rate < 1 || freq <= 0.0 || freq >= sample_rate / 2.0 || q <= 0.0) {
+		throw Parameters_Exception("Filter frequency must lie in (0, sample_rate / 2) and Q must be positive.\n");
+	}
+}
+
+static BiquadCoefs Normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+	BiquadCoefs c;
+	c.b0 = (float)(b0 / a0);
+	c.b1 = (float)(b1 / a0);
+	c.b2 = (float)(b2 / a0);
+	c.a1 = (float)(a1 / a0);
+	c.a2 = (float)(a2 / a0);
+	return c;
+}
+
+BiquadCoefs BiquadCoefs::LowPass(int sample_rate, double freq, double q) {
+	CheckFrequency(sample_rate, freq, q);
+	double w0 = 2.0 * PI * freq / sample_rate;
+	double alpha = sin(w0) / (2.0 * q);
+	double cw = cos(w0);
+	return Normalize((1.0 - cw) / 2.0, 1.0 - cw, (1.0 - cw) / 2.0, 1.0 + alpha, -2.0 * cw, 1.0 - alpha);
+}
+BiquadCoefs BiquadCoefs::HighPass(int sample_rate, double freq, double q) {
+	CheckFrequency(sample_rate, freq, q);
+	double w0 = 2.0 * PI * freq / sample_rate;
+	double alpha = sin(w0) / (2.0 * q);
+	double cw = cos(w0);
+	return Normalize((1.0 + cw) / 2.0, -(1.0 + cw), (1.0 + cw) / 2.0, 1.0 + alpha, -2.0 * cw, 1.0 - alpha);
+}
+BiquadCoefs BiquadCoefs::Peaking(int sample_rate, double freq, double q, double gain_db) {
+	CheckFrequency(sample_rate, freq, q);
+	double w0 = 2.0 * PI * freq / sample_rate;
+	double alpha = sin(w0) / (2.0 * q);
+	double cw = cos(w0);
+	double a = pow(10.0, gain_db / 40.0);
+	return Normalize(1.0 + alpha * a, -2.0 * cw, 1.0 - alpha * a, 1.0 + alpha / a, -2.0 * cw, 1.0 - alpha / a);
+}
+
+BiquadBank::BiquadBank(int chan_count, int stage_count) : channels(chan_count), stages(stage_count) {
+	if (channels < 1 || stages < 1) {
+		throw Parameters_Exception("Filter bank needs at least one channel and one stage.\n");
+	}
+	lanes = (channels + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+	coefs.assign(stages * 5 * lanes, 0.0f);
+	state.assign(stages * 2 * lanes, 0.0f);
+	frame.assign(lanes, 0.0f);
+
+	// Every section starts as a pass-through.
+	BiquadCoefs identity;
+	for (int s = 0; s < stages; s++) {
+		SetStage(s, identity);
+	}
+}
+
+void BiquadBank::SetStage(int stage, int channel, const BiquadCoefs& c) {
+	if (stage < 0 || stage >= stages || channel < 0 || channel >= channels) {
+		throw Parameters_Exception("Filter stage or channel is out of range.\n");
+	}
+	float* dst = &coefs[stage * 5 * lanes + channel];
+	dst[0 * lanes] = c.b0;
+	dst[1 * lanes] = c.b1;
+	dst[2 * lanes] = c.b2;
+	dst[3 * lanes] = c.a1;
+	dst[4 * lanes] = c.a2;
+}
+void BiquadBank::SetStage(int stage, const BiquadCoefs& c) {
+	for (int ch = 0; ch < channels; ch++) {
+		SetStage(stage, ch, c);
+	}
+}
+void BiquadBank::Reset() {
+	state.assign(state.size(), 0.0f);
+}
+
+void BiquadBank::Process(float* interleaved, size_t frames) {
+	for (size_t group = 0; group < lanes; group += LANE_WIDTH) {
+		// Channels of one frame are adjacent in an interleaved buffer, so a full group
+		// is loaded straight from it. The last, partial group goes through 'frame'.
+		bool full = group + LANE_WIDTH <= (size_t)channels;
+		size_t tail = channels - group;
+
+		for (size_t i = 0; i < frames; i++) {
+			float* src = interleaved + i * channels + group;
+			if (!full) {
+				for (size_t ch = 0; ch < tail; ch++) {
+					frame[group + ch] = src[ch];
+				}
+			}
+			lane_t x = vload(full ? src : &frame[group]);
+
+			for (int s = 0; s < stages; s++) {
+				const float* c = &coefs[s * 5 * lanes + group];
+				float* z = &state[s * 2 * lanes + group];
+				lane_t z1 = vload(z);
+				lane_t z2 = vload(z + lanes);
+
+				lane_t y = vadd(vmul(vload(c), x), z1);
+				z1 = vadd(vsub(vmul(vload(c + lanes), x), vmul(vload(c + 3 * lanes), y)), z2);
+				z2 = vsub(vmul(vload(c + 2 * lanes), x), vmul(vload(c + 4 * lanes), y));
+
+				vstore(z, z1);
+				vstore(z + lanes, z2);
+				x = y;
+			}
+
+			if (full) {
+				vstore(src, x);
+			}
+			else {
+				vstore(&frame[group], x);
+				for (size_t ch = 0; ch < tail; ch++) {
+					src[ch] = frame[group + ch];
+				}
+			}
+		}
+	}
+}
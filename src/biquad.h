@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+#include "WavExceptions.h"
+
+// Normalized biquad coefficients (a0 == 1), formulas from the RBJ Audio EQ Cookbook.
+struct BiquadCoefs {
+	float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f;
+	float a1 = 0.0f, a2 = 0.0f;
+
+	static BiquadCoefs LowPass(int sample_rate, double freq, double q);
+	static BiquadCoefs HighPass(int sample_rate, double freq, double q);
+	static BiquadCoefs Peaking(int sample_rate, double freq, double q, double gain_db);
+};
+
+// Cascade of biquad sections with per-channel coefficients.
+// A recursive filter can't be vectorized along time, so channels are processed
+// side by side in SIMD lanes: coefficients and state are stored lane-major,
+// padded up to the vector width (4 lanes with SSE, 8 with AVX).
+// Filter state is kept between Process calls, so a signal may be fed block by block.
+class BiquadBank {
+public:
+	BiquadBank(int channels, int stages);
+
+	int Channels() const { return channels; }
+	int Stages() const { return stages; }
+
+	void SetStage(int stage, int channel, const BiquadCoefs& c);
+	// Sets the same section for every channel.
+	void SetStage(int stage, const BiquadCoefs& c);
+	// Clears the filter state, coefficients are kept.
+	void Reset();
+
+	// Filters 'frames' interleaved frames in place.
+	void Process(float* interleaved, size_t frames);
+private:
+	int channels;
+	int stages;
+	size_t lanes;
+	// coefs[(stage * 5 + k) * lanes + ch], k = b0, b1, b2, a1, a2.
+	std::vector<float> coefs;
+	// state[(stage * 2 + k) * lanes + ch], k = z1, z2 (transposed direct form II).
+	std::vector<float> state;
+	std::vector<float> frame;
+};
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+
+#include "budget.h"
+
+// Every operator new block starts with its size, so operator delete can subtract it.
+// The header keeps the returned pointer aligned like malloc's.
+static const size_t HEAP_HEADER = alignof(std::max_align_t);
+static thread_local long long heap_in_use = 0;
+static thread_local long long heap_peak = 0;
+
+void* operator new(size_t size)
+{
+	void* block = malloc(size + HEAP_HEADER);
+	if (block == NULL) {
+		throw std::bad_alloc();
+	}
+	*(size_t*)block = size;
+	heap_in_use += size;
+	heap_peak = std::max(heap_peak, heap_in_use);
+	return (char*)block + HEAP_HEADER;
+}
+void operator delete(void* ptr) noexcept
+{
+	if (ptr == NULL) {
+		return;
+	}
+	char* block = (char*)ptr - HEAP_HEADER;
+	// Blocks freed by another thread than the one that allocated them only skew the
+	// counters of those two threads, which is why they are signed.
+	heap_in_use -= *(size_t*)block;
+	free(block);
+}
+
+long long ThreadHeapInUse()
+{
+	return heap_in_use;
+}
+long long ThreadHeapPeak()
+{
+	return heap_peak;
+}
+void ResetThreadHeapPeak()
+{
+	heap_peak = heap_in_use;
+}
+
+const char* LoadModeName(LoadMode mode)
+{
+	switch (mode) {
+	case LOAD_IN_MEMORY:
+		return "memory";
+	case LOAD_MMAP:
+		return "mmap";
+	default:
+		return "streaming";
+	}
+}
+
+MemoryBudget::MemoryBudget(size_t limit_bytes) : limit(limit_bytes), in_use(0), peak(0) {}
+
+bool MemoryBudget::TryReserve(size_t bytes) {
+	size_t current = in_use.load();
+	do {
+		if (bytes > limit || current > limit - bytes) {
+			return false;
+		}
+	} while (!in_use.compare_exchange_weak(current, current + bytes));
+
+	size_t seen = peak.load();
+	while (current + bytes > seen && !peak.compare_exchange_weak(seen, current + bytes)) {
+	}
+	return true;
+}
+void MemoryBudget::Release(size_t bytes) {
+	in_use -= bytes;
+}
+
+size_t MemoryBudget::PeakRss() {
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	// Linux reports kilobytes.
+	return (size_t)usage.ru_maxrss * 1024;
+}
+
+JobBudget::JobBudget(MemoryBudget& budget, size_t job_limit_bytes)
+	: process(budget), job_limit(job_limit_bytes), reserved(0) {}
+JobBudget::~JobBudget() {
+	process.Release(reserved);
+}
+
+size_t JobBudget::Available() const {
+	size_t process_left = process.Limit() - std::min(process.Limit(), process.InUse());
+	return std::min(job_limit - std::min(job_limit, reserved), process_left);
+}
+bool JobBudget::TryReserve(size_t bytes) {
+	if (reserved + bytes > job_limit || !process.TryReserve(bytes)) {
+		return false;
+	}
+	reserved += bytes;
+	return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+#include "WavExceptions.h"
+
+// How a job holds its samples.
+enum LoadMode {
+	LOAD_IN_MEMORY = 0, // Wav reads the file through an interleaved copy.
+	LOAD_MMAP,          // Wav deinterleaves straight from a read-only mapping of the file.
+	LOAD_STREAMING      // Blocks are read, processed and written one at a time.
+};
+
+const char* LoadModeName(LoadMode mode);
+
+// Process-wide memory budget. Jobs reserve their estimated peak before they allocate.
+class MemoryBudget {
+public:
+	MemoryBudget(size_t limit_bytes);
+
+	size_t Limit() const { return limit; }
+	size_t InUse() const { return in_use; }
+	size_t Peak() const { return peak; }
+
+	// Reserves 'bytes' if it fits under the limit.
+	bool TryReserve(size_t bytes);
+	void Release(size_t bytes);
+
+	// Peak resident set size of the whole process, from getrusage.
+	static size_t PeakRss();
+private:
+	size_t limit;
+	std::atomic<size_t> in_use;
+	std::atomic<size_t> peak;
+};
+
+// Heap bytes the calling thread allocated through operator new and hasn't freed yet,
+// and the highest that got since the last ResetThreadHeapPeak. This measures what a job
+// really used, next to the estimate it reserved. Mapped files and posix_memalign buffers
+// are not included.
+long long ThreadHeapInUse();
+long long ThreadHeapPeak();
+void ResetThreadHeapPeak();
+
+// Reservation of one job inside a MemoryBudget, released on destruction.
+class JobBudget {
+public:
+	JobBudget(MemoryBudget& process, size_t job_limit_bytes);
+	~JobBudget();
+
+	size_t Reserved() const { return reserved; }
+	// Bytes this job may still reserve: its own limit or what the process has left.
+	size_t Available() const;
+	bool TryReserve(size_t bytes);
+private:
+	MemoryBudget& process;
+	size_t job_limit;
+	size_t reserved;
+};
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "wav.h"
+
+using namespace std::chrono;
+
+static const size_t LATENCY_WINDOW = 4096;
+static const size_t MAX_REQUEST = 4096;
+// Time a client gets to send its whole request line.
+static const int REQUEST_TIMEOUT_MS = 2000;
+
+// Sends 'message' and closes the connection. A client that already hung up is not an error.
+static void Reply(int client, const std::string& message)
+{
+	send(client, message.data(), message.size(), MSG_NOSIGNAL);
+	close(client);
+}
+
+WavDaemon::WavDaemon(const std::string& path, int worker_count, size_t capacity,
+	size_t memory_limit, size_t job_limit)
+	: socket_path(path), queue_capacity(capacity), memory(memory_limit), job_memory_limit(job_limit), stopping(false),
+	completed(0), failed(0), rejected(0), bytes_processed(0),
+	latencies_ms(LATENCY_WINDOW, 0.0), job_peaks(LATENCY_WINDOW, 0), latency_pos(0), started(steady_clock::now()) {
+	if (worker_count < 1 || queue_capacity < 1) {
+		throw Parameters_Exception("Daemon needs at least one worker and a non-empty queue.\n");
+	}
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path)) {
+		throw Parameters_Exception("Socket path " + socket_path + " is too long.\n");
+	}
+	strcpy(addr.sun_path, socket_path.c_str());
+
+	// Only a stale socket from an earlier run may be replaced, never an ordinary file.
+	struct stat st;
+	if (lstat(socket_path.c_str(), &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			throw Parameters_Exception(socket_path + " exists and is not a socket.\n");
+		}
+		unlink(socket_path.c_str());
+	}
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		throw WavException("Can't create socket.\n");
+	}
+	// Jobs read and write files with the daemon's rights, so only its own user may connect.
+	// No other threads run yet, so changing the umask around bind is safe.
+	mode_t old_mask = umask(0177);
+	bool bound = bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+	umask(old_mask);
+	if (!bound || listen(listen_fd, 128) != 0) {
+		close(listen_fd);
+		throw WavException("Can't listen on " + socket_path + "\n");
+	}
+
+	// Workers start right away and stay warm between jobs.
+	for (int i = 0; i < worker_count; i++) {
+		workers.push_back(std::thread(&WavDaemon::WorkerLoop, this));
+	}
+}
+WavDaemon::~WavDaemon() {
+	Stop();
+	for (size_t i = 0; i < workers.size(); i++) {
+		if (workers[i].joinable()) {
+			workers[i].join();
+		}
+	}
+	close(listen_fd);
+	unlink(socket_path.c_str());
+}
+
+void WavDaemon::Stop() {
+	// Set under the lock so a worker can't miss the wake-up between its check and wait.
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	has_jobs.notify_all();
+}
+
+// A connection whose request line hasn't fully arrived yet.
+struct PendingClient {
+	int fd;
+	std::string request;
+	steady_clock::time_point deadline;
+};
+
+void WavDaemon::Run() {
+	// Requests are read with non-blocking sockets in this one poll loop, so a slow
+	// client only holds its own connection and never the accept loop.
+	std::vector<PendingClient> pending;
+	std::vector<pollfd> pfds;
+	while (!stopping) {
+		pfds.resize(pending.size() + 1);
+		pfds[0].fd = listen_fd;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+		for (size_t i = 0; i < pending.size(); i++) {
+			pfds[i + 1].fd = pending[i].fd;
+			pfds[i + 1].events = POLLIN;
+			pfds[i + 1].revents = 0;
+		}
+		// Wake up regularly to notice Stop() from another thread and expired requests.
+		poll(pfds.data(), pfds.size(), 200);
+
+		steady_clock::time_point now = steady_clock::now();
+		std::vector<PendingClient> still_pending;
+		for (size_t i = 0; i < pending.size(); i++) {
+			PendingClient& pc = pending[i];
+			bool closed = false;
+			if (pfds[i + 1].revents != 0) {
+				char buffer[512];
+				ssize_t got = recv(pc.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+				if (got > 0) {
+					pc.request.append(buffer, got);
+				}
+				else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+					closed = true;
+				}
+			}
+			size_t newline = pc.request.find('\n');
+			if (newline != std::string::npos) {
+				HandleRequest(pc.fd, pc.request.substr(0, newline));
+			}
+			else if (closed || pc.request.size() >= MAX_REQUEST || now >= pc.deadline) {
+				Reply(pc.fd, "ERR incomplete request\n");
+			}
+			else {
+				still_pending.push_back(pc);
+			}
+		}
+		pending.swap(still_pending);
+
+		if (pfds[0].revents & POLLIN) {
+			int client = accept(listen_fd, NULL, NULL);
+			if (client >= 0) {
+				PendingClient pc;
+				pc.fd = client;
+				pc.deadline = now + milliseconds(REQUEST_TIMEOUT_MS);
+				pending.push_back(pc);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		Reply(pending[i].fd, "ERR shutting down\n");
+	}
+	Stop();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+void WavDaemon::HandleRequest(int client, const std::string& request) {
+	std::istringstream in(request);
+	std::string command;
+	in >> command;
+
+	if (command == "STATS") {
+		DaemonStats s = Stats();
+		std::ostringstream out;
+		out << "queue=" << s.queue_depth << " completed=" << s.completed << " failed=" << s.failed
+			<< " rejected=" << s.rejected << " p50_ms=" << s.p50_ms << " p95_ms=" << s.p95_ms
+			<< " p99_ms=" << s.p99_ms << " jobs_per_s=" << s.jobs_per_second
+			<< " mb_per_s=" << s.megabytes_per_second << " mem_reserved_est=" << s.memory_reserved
+			<< " mem_reserved_est_peak=" << s.memory_reserved_peak << " job_peak_measured_max=" << s.job_peak_max
+			<< " lifetime_peak_rss=" << s.lifetime_peak_rss << "\n";
+		Reply(client, out.str());
+	}
+	else if (command == "SHUTDOWN") {
+		Reply(client, "OK\n");
+		Stop();
+	}
+	else if (command == "JOB") {
+		Job job;
+		job.client = client;
+		job.accepted = steady_clock::now();
+		std::string op;
+		if (!(in >> job.input >> job.output)) {
+			Reply(client, "ERR JOB needs an input and an output path\n");
+			return;
+		}
+		while (in >> op) {
+			job.ops.push_back(op);
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		// Bounded queue: tell the client to back off instead of piling up work.
+		if (queue.size() >= queue_capacity) {
+			rejected++;
+			size_t depth = queue.size();
+			lock.unlock();
+			Reply(client, "BUSY " + std::to_string(depth) + "\n");
+			return;
+		}
+		queue.push_back(job);
+		lock.unlock();
+		has_jobs.notify_one();
+	}
+	else {
+		Reply(client, "ERR unknown request\n");
+	}
+}
+
+void WavDaemon::WorkerLoop() {
+	// Filter banks and streaming blocks survive between the jobs of one worker.
+	JobScratch scratch;
+	for (;;) {
+		std::unique_lock<std::mutex> lock(mutex);
+		has_jobs.wait(lock, [this]() { return !queue.empty() || stopping; });
+		if (queue.empty()) {
+			return;
+		}
+		Job job = queue.front();
+		queue.pop_front();
+		lock.unlock();
+
+		std::string error;
+		JobReport report;
+		try {
+			JobBudget budget(memory, job_memory_limit);
+			report = RunJob(job.input, job.output, job.ops, budget, scratch);
+		}
+		catch (WavException& e) {
+			error = e.what();
+		}
+		catch (std::exception& e) {
+			error = e.what();
+		}
+		double ms = duration<double, std::milli>(steady_clock::now() - job.accepted).count();
+
+		lock.lock();
+		if (error.empty()) {
+			completed++;
+			bytes_processed += report.input_bytes;
+			job_peaks[latency_pos % LATENCY_WINDOW] = report.measured_peak_bytes;
+			latencies_ms[latency_pos++ % LATENCY_WINDOW] = ms;
+		}
+		else {
+			failed++;
+		}
+		lock.unlock();
+
+		if (error.empty()) {
+			Reply(job.client, "OK " + std::to_string(ms) + " " + LoadModeName(report.mode) + " " +
+				std::to_string(report.reserved_bytes) + " " + std::to_string(report.measured_peak_bytes) + " " +
+				std::to_string(report.write.MegabytesPerSecond()) + "\n");
+		}
+		else {
+			error.erase(std::remove(error.begin(), error.end(), '\n'), error.end());
+			Reply(job.client, "ERR " + error + "\n");
+		}
+	}
+}
+
+DaemonStats WavDaemon::Stats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	DaemonStats s;
+	s.queue_depth = queue.size();
+	s.completed = completed;
+	s.failed = failed;
+	s.rejected = rejected;
+	s.memory_reserved = memory.InUse();
+	s.memory_reserved_peak = memory.Peak();
+	s.lifetime_peak_rss = MemoryBudget::PeakRss();
+	size_t recent = std::min(latency_pos, LATENCY_WINDOW);
+	for (size_t i = 0; i < recent; i++) {
+		s.job_peak_max = std::max(s.job_peak_max, job_peaks[i]);
+	}
+
+	std::vector<double> window(latencies_ms.begin(), latencies_ms.begin() + std::min(latency_pos, LATENCY_WINDOW));
+	if (!window.empty()) {
+		std::sort(window.begin(), window.end());
+		s.p50_ms = window[(window.size() - 1) * 50 / 100];
+		s.p95_ms = window[(window.size() - 1) * 95 / 100];
+		s.p99_ms = window[(window.size() - 1) * 99 / 100];
+	}
+
+	double seconds = duration<double>(steady_clock::now() - started).count();
+	if (seconds > 0.0) {
+		s.jobs_per_second = completed / seconds;
+		s.megabytes_per_second = bytes_processed / seconds / 1e6;
+	}
+	return s;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "budget.h"
+#include "job.h"
+#include "WavExceptions.h"
+
+struct DaemonStats {
+	size_t queue_depth = 0;
+	size_t completed = 0;
+	size_t failed = 0;
+	size_t rejected = 0;
+	double p50_ms = 0.0;
+	double p95_ms = 0.0;
+	double p99_ms = 0.0;
+	double jobs_per_second = 0.0;
+	double megabytes_per_second = 0.0;
+	// Estimates reserved in the memory budget: now and at most.
+	size_t memory_reserved = 0;
+	size_t memory_reserved_peak = 0;
+	// Largest measured per-job heap peak among the latest jobs.
+	size_t job_peak_max = 0;
+	// Process-wide, since start; it never goes down.
+	size_t lifetime_peak_rss = 0;
+};
+
+// Long-running service that takes processing jobs over a Unix domain socket.
+// The socket is created with mode 0600, so only the daemon's own user can submit jobs.
+// One request per connection, one line per request, whitespace separated:
+//   JOB <input> <output> [op ...]   ops: mono, reverb:<delay>:<decay>, resample:<rate>,
+//                                        highpass:<hz>, lowpass:<hz>, strip,
+//                                        and the write options sync, direct, noprealloc
+//   STATS
+//   SHUTDOWN
+// Every job runs under a per-job memory limit inside the daemon's total memory limit
+// and picks its load mode accordingly (see RunJob).
+// A job is answered with "OK <ms> <mode> <estimated_bytes> <measured_peak_bytes> <write_mb_per_s>"
+// or "ERR <message>" once it is done, or with "BUSY <depth>" right away when the queue is full.
+// The estimate is what the job reserved in the budget; the measured peak is its heap high-water mark.
+class WavDaemon {
+public:
+	WavDaemon(const std::string& socket_path, int workers, size_t queue_capacity,
+		size_t memory_limit, size_t job_memory_limit);
+	~WavDaemon();
+
+	// Serves requests until Stop() or a SHUTDOWN request, then drains the queue.
+	void Run();
+	void Stop();
+	DaemonStats Stats();
+private:
+	struct Job {
+		int client;
+		std::string input;
+		std::string output;
+		std::vector<std::string> ops;
+		std::chrono::steady_clock::time_point accepted;
+	};
+	void HandleRequest(int client, const std::string& request);
+	void WorkerLoop();
+
+	std::string socket_path;
+	int listen_fd;
+	size_t queue_capacity;
+	MemoryBudget memory;
+	size_t job_memory_limit;
+	std::atomic<bool> stopping;
+
+	std::mutex mutex;
+	std::condition_variable has_jobs;
+	std::deque<Job> queue;
+	std::vector<std::thread> workers;
+
+	// Guarded by 'mutex'.
+	size_t completed;
+	size_t failed;
+	size_t rejected;
+	size_t bytes_processed;
+	// Latest job latencies in a ring, enough for stable percentiles.
+	std::vector<double> latencies_ms;
+	// Measured heap peaks of the same jobs.
+	std::vector<size_t> job_peaks;
+	size_t latency_pos;
+	std::chrono::steady_clock::time_point started;
+};
@@ -0,0 +1,58 @@
+#include <cmath>
+
+#include "fft.h"
+
+FFT::FFT(size_t size) : n(size) {
+	if (n < 2 || (n & (n - 1)) != 0) {
+		throw Parameters_Exception("FFT size must be a power of two.\n");
+	}
+
+	twiddles.resize(n / 2);
+	for (size_t k = 0; k < n / 2; k++) {
+		double angle = -2.0 * 3.14159265358979323846 * k / n;
+		twiddles[k] = std::complex<float>((float)cos(angle), (float)sin(angle));
+	}
+
+	size_t bits = 0;
+	while (((size_t)1 << bits) < n) {
+		bits++;
+	}
+	reversed.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		size_t r = 0;
+		for (size_t b = 0; b < bits; b++) {
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		reversed[i] = r;
+	}
+}
+
+void FFT::Forward(std::complex<float>* data) const {
+	for (size_t i = 0; i < n; i++) {
+		if (i < reversed[i]) {
+			std::swap(data[i], data[reversed[i]]);
+		}
+	}
+	for (size_t len = 2; len <= n; len <<= 1) {
+		size_t half = len / 2;
+		size_t step = n / len;
+		for (size_t start = 0; start < n; start += len) {
+			for (size_t k = 0; k < half; k++) {
+				std::complex<float> t = twiddles[k * step] * data[start + k + half];
+				data[start + k + half] = data[start + k] - t;
+				data[start + k] += t;
+			}
+		}
+	}
+}
+
+void FFT::Magnitudes(const float* signal, float* magnitudes, std::vector<std::complex<float>>& work) const {
+	work.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		work[i] = std::complex<float>(signal[i], 0.0f);
+	}
+	Forward(work.data());
+	for (size_t k = 0; k < n / 2; k++) {
+		magnitudes[k] = std::abs(work[k]);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+#include "WavExceptions.h"
+
+// Iterative radix-2 FFT. Twiddle factors and the bit-reversal permutation
+// are computed once per size, so one object can transform many frames.
+class FFT {
+public:
+	FFT(size_t n);
+
+	size_t Size() const { return n; }
+
+	// In-place forward transform of 'data', which must hold Size() values.
+	void Forward(std::complex<float>* data) const;
+	// Magnitudes of the first Size() / 2 bins of a real signal.
+	// 'work' is scratch space, kept by the caller to avoid reallocating per frame.
+	void Magnitudes(const float* signal, float* magnitudes, std::vector<std::complex<float>>& work) const;
+private:
+	size_t n;
+	std::vector<std::complex<float>> twiddles;
+	std::vector<size_t> reversed;
+};
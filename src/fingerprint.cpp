@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "fft.h"
+#include "fingerprint.h"
+#include "wav.h"
+
+// Peaks are searched in these bands, one candidate per band and frame.
+static const double BAND_EDGES_HZ[] = { 40, 300, 600, 1200, 2400, 5000 };
+static const size_t BAND_COUNT = sizeof(BAND_EDGES_HZ) / sizeof(BAND_EDGES_HZ[0]) - 1;
+// Each peak is paired with up to FAN_OUT later peaks no more than MAX_DT frames away.
+static const size_t FAN_OUT = 5;
+static const uint32_t MAX_DT = 63;
+// Every signal is analysed at this rate, so frames and frequency bins mean the same
+// for files recorded at different sample rates. It still covers the top band.
+static const int ANALYSIS_RATE = 11025;
+// Peak frequencies are quantized to 10 Hz.
+static const double FREQ_STEP_HZ = 10.0;
+
+// Version 2: analysis at a fixed rate; version 1 indexes used the file's own rate.
+static const char INDEX_MAGIC[4] = { 'W', 'F', 'P', '2' };
+
+struct Peak {
+	uint32_t frame;
+	uint32_t freq;
+};
+
+Fingerprint ComputeFingerprint(const std::vector<short>& input, int input_rate)
+{
+	if (input_rate < 1) {
+		throw Parameters_Exception("Sample rate must be positive.\n");
+	}
+	std::vector<short> resampled;
+	if (input_rate != ANALYSIS_RATE) {
+		resampled = ResampleChannel(input, input_rate, ANALYSIS_RATE);
+	}
+	const std::vector<short>& mono = input_rate != ANALYSIS_RATE ? resampled : input;
+	const int sample_rate = ANALYSIS_RATE;
+
+	// 512 point windows (46 ms) with 50% overlap.
+	size_t n = 2;
+	while (n < sample_rate * 0.046) {
+		n <<= 1;
+	}
+	size_t hop = n / 2;
+	FFT fft(n);
+
+	std::vector<float> window(n);
+	for (size_t i = 0; i < n; i++) {
+		window[i] = (float)(0.5 - 0.5 * cos(2.0 * 3.14159265358979323846 * i / (n - 1)));
+	}
+
+	size_t band_bins[BAND_COUNT + 1];
+	for (size_t b = 0; b <= BAND_COUNT; b++) {
+		band_bins[b] = std::min(n / 2, (size_t)(BAND_EDGES_HZ[b] * n / sample_rate));
+	}
+
+	std::vector<float> frame(n);
+	std::vector<float> magnitudes(n / 2);
+	std::vector<std::complex<float>> work;
+	std::vector<Peak> peaks;
+
+	for (size_t begin = 0, t = 0; begin + n <= mono.size(); begin += hop, t++) {
+		for (size_t i = 0; i < n; i++) {
+			frame[i] = window[i] * mono[begin + i];
+		}
+		fft.Magnitudes(frame.data(), magnitudes.data(), work);
+
+		// Strongest bin of every band; keep the ones louder than the average of them.
+		size_t best[BAND_COUNT];
+		float mean = 0.0f;
+		for (size_t b = 0; b < BAND_COUNT; b++) {
+			best[b] = band_bins[b];
+			for (size_t k = band_bins[b]; k < band_bins[b + 1]; k++) {
+				if (magnitudes[k] > magnitudes[best[b]]) {
+					best[b] = k;
+				}
+			}
+			mean += magnitudes[best[b]] / BAND_COUNT;
+		}
+		// Ignore near-silent frames, their peaks are just noise.
+		if (mean < 10.0f * n) {
+			continue;
+		}
+		for (size_t b = 0; b < BAND_COUNT; b++) {
+			if (magnitudes[best[b]] >= mean) {
+				double freq = (double)best[b] * sample_rate / n;
+				peaks.push_back({ (uint32_t)t, (uint32_t)std::min(1023.0, freq / FREQ_STEP_HZ) });
+			}
+		}
+	}
+
+	Fingerprint fp;
+	fp.frame_seconds = (double)hop / sample_rate;
+	for (size_t i = 0; i < peaks.size(); i++) {
+		size_t paired = 0;
+		for (size_t j = i + 1; j < peaks.size() && paired < FAN_OUT; j++) {
+			uint32_t dt = peaks[j].frame - peaks[i].frame;
+			if (dt == 0) {
+				continue;
+			}
+			if (dt > MAX_DT) {
+				break;
+			}
+			uint32_t hash = (peaks[i].freq << 20) | (peaks[j].freq << 10) | dt;
+			fp.points.push_back({ hash, peaks[i].frame });
+			paired++;
+		}
+	}
+	return fp;
+}
+
+Fingerprint FingerprintFile(const std::string& filename)
+{
+	Wav w(filename);
+	if (w.GetChannelsData().size() != 1) {
+		w.MakeMono();
+	}
+	return ComputeFingerprint(w.GetChannelsData()[0], w.GetSampleRate());
+}
+
+size_t FingerprintIndex::Add(const std::string& name, const Fingerprint& fp)
+{
+	uint32_t id = (uint32_t)names.size();
+	names.push_back(name);
+	frame_seconds.push_back(fp.frame_seconds);
+	for (size_t i = 0; i < fp.points.size(); i++) {
+		postings[fp.points[i].hash].push_back({ id, fp.points[i].frame });
+	}
+	return id;
+}
+
+std::vector<std::string> FingerprintIndex::AddFiles(const std::vector<std::string>& files, int threads)
+{
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	// Fingerprinting is independent per file; workers take the next file from a shared counter.
+	std::vector<Fingerprint> results(files.size());
+	std::vector<char> ok(files.size(), 0);
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&]() {
+			for (size_t i = next++; i < files.size(); i = next++) {
+				try {
+					results[i] = FingerprintFile(files[i]);
+					ok[i] = 1;
+				}
+				catch (WavException&) {
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+
+	// Inserting in input order keeps ids deterministic.
+	std::vector<std::string> failed;
+	for (size_t i = 0; i < files.size(); i++) {
+		if (ok[i]) {
+			Add(files[i], results[i]);
+		}
+		else {
+			failed.push_back(files[i]);
+		}
+	}
+	return failed;
+}
+
+std::vector<FingerprintMatch> FingerprintIndex::Query(const Fingerprint& fp, size_t max_results) const
+{
+	// Vote for (file, time offset) pairs; a real match piles up votes on one offset.
+	std::unordered_map<uint64_t, size_t> votes;
+	for (size_t i = 0; i < fp.points.size(); i++) {
+		auto it = postings.find(fp.points[i].hash);
+		if (it == postings.end()) {
+			continue;
+		}
+		for (const Posting& p : it->second) {
+			int64_t offset = (int64_t)p.frame - (int64_t)fp.points[i].frame;
+			votes[((uint64_t)p.id << 32) | (uint32_t)(int32_t)offset]++;
+		}
+	}
+
+	std::unordered_map<uint32_t, FingerprintMatch> best;
+	for (auto& v : votes) {
+		uint32_t id = (uint32_t)(v.first >> 32);
+		int32_t offset = (int32_t)(uint32_t)v.first;
+		auto it = best.find(id);
+		if (it == best.end() || it->second.score < v.second) {
+			FingerprintMatch m;
+			m.name = names[id];
+			m.id = id;
+			m.score = v.second;
+			m.similarity = fp.points.empty() ? 0.0 : (double)v.second / fp.points.size();
+			m.offset_seconds = offset * frame_seconds[id];
+			best[id] = m;
+		}
+	}
+
+	std::vector<FingerprintMatch> matches;
+	for (auto& b : best) {
+		matches.push_back(b.second);
+	}
+	std::sort(matches.begin(), matches.end(), [](const FingerprintMatch& a, const FingerprintMatch& b) {
+		return a.score != b.score ? a.score > b.score : a.id < b.id;
+	});
+	if (matches.size() > max_results) {
+		matches.resize(max_results);
+	}
+	return matches;
+}
+
+// On-disk layout: magic, file count, per file (name length, name, frame_seconds),
+// hash count, per hash (hash, posting count, postings).
+void FingerprintIndex::Save(const std::string& filename) const
+{
+	FILE* out = fopen(filename.c_str(), "wb");
+	if (out == NULL) {
+		throw Write_Exception(filename);
+	}
+	bool ok = fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, out) == 1;
+
+	uint32_t count = (uint32_t)names.size();
+	ok = ok && fwrite(&count, sizeof(count), 1, out) == 1;
+	for (size_t i = 0; i < names.size() && ok; i++) {
+		uint32_t len = (uint32_t)names[i].size();
+		ok = fwrite(&len, sizeof(len), 1, out) == 1 &&
+			fwrite(names[i].data(), 1, len, out) == len &&
+			fwrite(&frame_seconds[i], sizeof(double), 1, out) == 1;
+	}
+
+	uint32_t hashes = (uint32_t)postings.size();
+	ok = ok && fwrite(&hashes, sizeof(hashes), 1, out) == 1;
+	for (auto it = postings.begin(); it != postings.end() && ok; ++it) {
+		uint32_t size = (uint32_t)it->second.size();
+		ok = fwrite(&it->first, sizeof(it->first), 1, out) == 1 &&
+			fwrite(&size, sizeof(size), 1, out) == 1 &&
+			fwrite(it->second.data(), sizeof(Posting), size, out) == size;
+	}
+
+	if (fclose(out) != 0 || !ok) {
+		throw Write_Exception(filename);
+	}
+}
+
+void FingerprintIndex::Load(const std::string& filename)
+{
+	FILE* in = fopen(filename.c_str(), "rb");
+	if (in == NULL) {
+		throw IO_Exception(filename);
+	}
+	names.clear();
+	frame_seconds.clear();
+	postings.clear();
+
+	char magic[4];
+	uint32_t count = 0;
+	bool ok = fread(magic, sizeof(magic), 1, in) == 1 && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0 &&
+		fread(&count, sizeof(count), 1, in) == 1;
+	for (uint32_t i = 0; i < count && ok; i++) {
+		uint32_t len = 0;
+		double seconds = 0.0;
+		ok = fread(&len, sizeof(len), 1, in) == 1;
+		std::string name(ok ? len : 0, '\0');
+		ok = ok && fread(&name[0], 1, len, in) == len && fread(&seconds, sizeof(seconds), 1, in) == 1;
+		names.push_back(name);
+		frame_seconds.push_back(seconds);
+	}
+
+	uint32_t hashes = 0;
+	ok = ok && fread(&hashes, sizeof(hashes), 1, in) == 1;
+	for (uint32_t h = 0; h < hashes && ok; h++) {
+		uint32_t hash = 0, size = 0;
+		ok = fread(&hash, sizeof(hash), 1, in) == 1 && fread(&size, sizeof(size), 1, in) == 1;
+		if (ok) {
+			std::vector<Posting>& list = postings[hash];
+			list.resize(size);
+			ok = fread(list.data(), sizeof(Posting), size, in) == size;
+		}
+	}
+	fclose(in);
+
+	if (!ok) {
+		names.clear();
+		frame_seconds.clear();
+		postings.clear();
+		throw Format_Exception("Fingerprint index " + filename + " is damaged.\n");
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "WavExceptions.h"
+
+// One landmark: a hash of two spectral peaks and the frame of the first one.
+struct FingerprintPoint {
+	uint32_t hash;
+	uint32_t frame;
+};
+
+struct Fingerprint {
+	std::vector<FingerprintPoint> points;
+	// Duration of one analysis frame step, for converting frames to seconds.
+	double frame_seconds = 0.0;
+};
+
+struct FingerprintMatch {
+	std::string name;
+	size_t id;
+	// Number of landmarks that agree on the same time offset.
+	size_t score;
+	// Share of query landmarks that matched, 1.0 for an exact duplicate.
+	double similarity;
+	// Position of the query inside the matched file.
+	double offset_seconds;
+};
+
+// Spectral-peak landmark fingerprint of a mono signal. The signal is resampled to one
+// fixed analysis rate first, so copies of a recording at different rates match.
+Fingerprint ComputeFingerprint(const std::vector<short>& mono, int sample_rate);
+// Loads a WAV file, downmixes it with Wav::MakeMono and fingerprints it.
+Fingerprint FingerprintFile(const std::string& filename);
+
+// Inverted index from landmark hashes to the files and frames they occur in.
+// A query costs one hash lookup per landmark, independent of the library size.
+class FingerprintIndex {
+public:
+	size_t Size() const { return names.size(); }
+
+	// Adds one fingerprinted file and returns its id.
+	size_t Add(const std::string& name, const Fingerprint& fp);
+	// Fingerprints 'files' on 'threads' worker threads and adds them in order.
+	// Returns the files that couldn't be read.
+	std::vector<std::string> AddFiles(const std::vector<std::string>& files, int threads);
+
+	// Best matching files, most similar first.
+	std::vector<FingerprintMatch> Query(const Fingerprint& fp, size_t max_results) const;
+
+	void Save(const std::string& filename) const;
+	void Load(const std::string& filename);
+private:
+	struct Posting {
+		uint32_t id;
+		uint32_t frame;
+	};
+
+	std::vector<std::string> names;
+	std::vector<double> frame_seconds;
+	std::unordered_map<uint32_t, std::vector<Posting>> postings;
+};
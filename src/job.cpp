@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include "job.h"
+#include "wav.h"
+#include "wav_stream.h"
+
+static const size_t STREAM_BLOCK_FRAMES = 1 << 14;
+
+// Op text split at ':', the first part is the operation name.
+typedef std::vector<std::string> JobOp;
+
+struct PeakEstimate {
+	size_t in_memory;
+	size_t mmap;
+	size_t streaming;
+	bool streamable;
+};
+
+static JobOp Split(const std::string& text, char separator)
+{
+	JobOp parts;
+	std::istringstream in(text);
+	std::string part;
+	while (std::getline(in, part, separator)) {
+		parts.push_back(part);
+	}
+	return parts;
+}
+
+// Processing ops go to the returned list, write options (sync, direct, noprealloc) to 'options'.
+static std::vector<JobOp> ParseOps(const std::vector<std::string>& ops, WriteOptions& options)
+{
+	std::vector<JobOp> parsed;
+	for (size_t i = 0; i < ops.size(); i++) {
+		JobOp op = Split(ops[i], ':');
+		const std::string name = op.empty() ? "" : op[0];
+		if (ops[i] == "sync" || ops[i] == "direct" || ops[i] == "noprealloc") {
+			options.sync = options.sync || ops[i] == "sync";
+			options.direct_io = options.direct_io || ops[i] == "direct";
+			options.preallocate = options.preallocate && ops[i] != "noprealloc";
+			continue;
+		}
+		bool ok = ((name == "mono" || name == "strip") && op.size() == 1) ||
+			((name == "resample" || name == "highpass" || name == "lowpass") && op.size() == 2) ||
+			(name == "reverb" && op.size() == 3);
+		if (!ok) {
+			throw Parameters_Exception("Unknown operation " + ops[i]);
+		}
+		parsed.push_back(op);
+	}
+	return parsed;
+}
+
+// Follows the signal size through the ops and records the largest temporary each one needs,
+// mirroring what the Wav methods allocate.
+static PeakEstimate EstimatePeak(const wav_header_s& head, const std::vector<JobOp>& ops)
+{
+	double input = head.subchunk2Size;
+	double bytes = input;
+	double chan_count = head.numChannels;
+	double rate = head.sampleRate;
+	double largest = bytes;
+	double delay_lines = 0.0;
+
+	PeakEstimate e;
+	e.streamable = true;
+	for (size_t i = 0; i < ops.size(); i++) {
+		const std::string& name = ops[i][0];
+		if (name == "mono") {
+			largest = std::max(largest, bytes + bytes / chan_count);
+			bytes /= chan_count;
+			chan_count = 1;
+		}
+		else if (name == "reverb") {
+			// MakeReverb converts one channel at a time to float.
+			largest = std::max(largest, bytes + 2.0 * bytes / chan_count);
+			delay_lines += atof(ops[i][1].c_str()) * rate * chan_count * sizeof(float);
+		}
+		else if (name == "resample") {
+			double resampled = bytes * atof(ops[i][1].c_str()) / rate;
+			largest = std::max(largest, bytes + resampled / chan_count);
+			bytes = resampled;
+			rate = atof(ops[i][1].c_str());
+			e.streamable = false;
+		}
+		else if (name == "strip") {
+			e.streamable = false;
+		}
+	}
+
+	// Filters only need a small interleaved block. WriteWavFile needs a copy of the output,
+	// WavBlockWriter a block and its write chunk.
+	double block = (double)STREAM_BLOCK_FRAMES * head.numChannels * sizeof(float);
+	double write_chunk = (double)(1 << 20);
+	e.in_memory = (size_t)std::max(std::max(2.0 * input, largest), 2.0 * bytes) + (size_t)block;
+	e.mmap = (size_t)(std::max(largest, bytes) + block + write_chunk);
+	e.streaming = (size_t)(3.0 * block + delay_lines + write_chunk);
+	return e;
+}
+
+// The cached single-stage filter bank for a highpass/lowpass op, created on first use.
+// The key holds the parsed cutoff, so "100" and "100.0" share one bank.
+static BiquadBank& GetFilterBank(FilterCache& filters, const std::string& name, const std::string& arg,
+	int chan_count, int sample_rate)
+{
+	double freq = std::stod(arg);
+	if (!(freq > 0.0 && freq < sample_rate / 2.0)) {
+		throw Parameters_Exception("Cutoff " + arg + " Hz must lie between 0 and half the sample rate.\n");
+	}
+	char key[96];
+	snprintf(key, sizeof(key), "%s:%.9g/%d/%d", name.c_str(), freq, chan_count, sample_rate);
+	std::unique_ptr<BiquadBank>& bank = filters[key];
+	if (!bank) {
+		bank.reset(new BiquadBank(chan_count, 1));
+		bank->SetStage(0, name == "highpass" ?
+			BiquadCoefs::HighPass(sample_rate, freq, 0.7071) :
+			BiquadCoefs::LowPass(sample_rate, freq, 0.7071));
+	}
+	return *bank;
+}
+
+static void ApplyOps(Wav& w, const std::vector<JobOp>& ops, FilterCache& filters)
+{
+	for (size_t i = 0; i < ops.size(); i++) {
+		const JobOp& op = ops[i];
+		if (op[0] == "mono") {
+			w.MakeMono();
+		}
+		else if (op[0] == "reverb") {
+			w.MakeReverb(std::stod(op[1]), std::stof(op[2]));
+		}
+		else if (op[0] == "resample") {
+			w.Resample(std::stoi(op[1]));
+		}
+		else if (op[0] == "highpass" || op[0] == "lowpass") {
+			BiquadBank& bank = GetFilterBank(filters, op[0], op[1], (int)w.GetChannelsData().size(), w.GetSampleRate());
+			bank.Reset();
+			w.ApplyFilterBank(bank);
+		}
+		else if (op[0] == "strip") {
+			w.StripSilence(w.DetectActivity());
+		}
+	}
+}
+
+struct StreamStage {
+	std::string name;
+	int channels;
+	BiquadBank* bank;
+	size_t delay;
+	float decay;
+	std::vector<float> history;
+	size_t pos;
+	// Reverb only: frames seen in this pass, the frames MakeReverb takes its peak from,
+	// and the per-channel peak and normalization gain.
+	size_t frames_done;
+	size_t peak_frames;
+	std::vector<float> peaks;
+	std::vector<float> gains;
+};
+
+// Saturates and truncates like Wav::ApplyFilterBank and Wav::MakeReverb do.
+static float ToShort(float v)
+{
+	if (v > 32767.0f) v = 32767.0f;
+	if (v < -32768.0f) v = -32768.0f;
+	return (short)v;
+}
+
+// Runs one stage over 'frames' interleaved frames in 'work'. Every stage leaves 16-bit
+// values behind, exactly as the Wav method it stands for, so later stages see the same input.
+// With 'measure' a reverb stage only records its peaks and leaves 'work' unscaled.
+static void RunStage(StreamStage& st, float* work, size_t frames, bool measure)
+{
+	if (st.name == "mono") {
+		for (size_t i = 0; i < frames; i++) {
+			work[i] = (float)(((int)work[2 * i] + (int)work[2 * i + 1]) / 2);
+		}
+	}
+	else if (st.bank) {
+		st.bank->Process(work, frames);
+		for (size_t i = 0; i < frames * st.channels; i++) {
+			work[i] = ToShort(work[i]);
+		}
+	}
+	else {
+		// Same recursion as MakeReverb: y[n] = x[n] + decay * y[n - delay].
+		for (size_t i = 0; i < frames; i++) {
+			float* h = st.delay > 0 ? &st.history[st.pos * st.channels] : NULL;
+			bool in_peak_window = st.frames_done + i < st.peak_frames;
+			for (int ch = 0; ch < st.channels; ch++) {
+				float y = work[i * st.channels + ch];
+				if (h) {
+					y += st.decay * h[ch];
+					h[ch] = y;
+				}
+				if (measure) {
+					if (in_peak_window) {
+						st.peaks[ch] = std::max(st.peaks[ch], std::fabs(y));
+					}
+				}
+				else {
+					work[i * st.channels + ch] = ToShort(st.gains[ch] * y);
+				}
+			}
+			if (h && ++st.pos == st.delay) {
+				st.pos = 0;
+			}
+		}
+		st.frames_done += frames;
+	}
+}
+
+// Block streaming version of ApplyOps, with the same output as the in-memory path.
+// MakeReverb normalizes by the whole-signal peak of its own output, so every reverb
+// stage costs one extra read of the input that runs the stages up to it and measures it.
+static WriteStats RunStreaming(const std::string& input, const std::string& output,
+	const std::vector<JobOp>& ops, JobScratch& scratch, const WriteOptions& options)
+{
+	WavBlockReader reader(input);
+	int sample_rate = reader.SampleRate();
+	int chan_count = reader.Channels();
+
+	std::vector<StreamStage> stages;
+	std::vector<size_t> reverbs;
+	std::vector<std::unique_ptr<BiquadBank>> repeated;
+	for (size_t i = 0; i < ops.size(); i++) {
+		StreamStage st;
+		st.name = ops[i][0];
+		st.channels = chan_count;
+		st.bank = NULL;
+		st.delay = 0;
+		st.decay = 0.0f;
+		st.pos = 0;
+		st.frames_done = 0;
+		st.peak_frames = 0;
+		if (st.name == "mono") {
+			if (chan_count != 2) {
+				throw Parameters_Exception("Can't make mono out of " + std::to_string(chan_count) + " channel.\n");
+			}
+			chan_count = 1;
+		}
+		else if (st.name == "highpass" || st.name == "lowpass") {
+			st.bank = &GetFilterBank(scratch.filters, st.name, ops[i][1], chan_count, sample_rate);
+			// All stages run side by side here, so a repeated filter needs its own state.
+			for (size_t s = 0; s < stages.size(); s++) {
+				if (stages[s].bank == st.bank) {
+					repeated.push_back(std::unique_ptr<BiquadBank>(new BiquadBank(*st.bank)));
+					st.bank = repeated.back().get();
+					break;
+				}
+			}
+		}
+		else if (st.name == "reverb") {
+			st.delay = (size_t)(std::stod(ops[i][1]) * sample_rate);
+			st.decay = std::stof(ops[i][2]);
+			st.history.resize(st.delay * chan_count);
+			st.peak_frames = reader.Frames() > st.delay ? reader.Frames() - st.delay : 0;
+			st.peaks.resize(chan_count);
+			st.gains.resize(chan_count, 1.0f);
+			reverbs.push_back(stages.size());
+		}
+		else {
+			throw Memory_Exception("Operation " + st.name + " can't run in streaming mode.\n");
+		}
+		stages.push_back(st);
+	}
+
+	int in_channels = reader.Channels();
+	std::vector<short>& in = scratch.in;
+	std::vector<float>& work = scratch.work;
+	std::vector<short>& out = scratch.out;
+	in.resize(STREAM_BLOCK_FRAMES * in_channels);
+	work.resize(STREAM_BLOCK_FRAMES * in_channels);
+	out.resize(STREAM_BLOCK_FRAMES * chan_count);
+
+	WriteStats stats;
+	// Pass p < reverbs.size() measures reverb stage reverbs[p], the last pass writes.
+	for (size_t pass = 0; pass <= reverbs.size(); pass++) {
+		bool measure = pass < reverbs.size();
+		size_t stage_count = measure ? reverbs[pass] + 1 : stages.size();
+		reader.Seek(0);
+		for (size_t s = 0; s < stage_count; s++) {
+			if (stages[s].bank) {
+				stages[s].bank->Reset();
+			}
+			std::fill(stages[s].history.begin(), stages[s].history.end(), 0.0f);
+			std::fill(stages[s].peaks.begin(), stages[s].peaks.end(), 0.0f);
+			stages[s].pos = 0;
+			stages[s].frames_done = 0;
+		}
+		std::unique_ptr<WavBlockWriter> writer;
+		if (!measure) {
+			writer.reset(new WavBlockWriter(output, chan_count, sample_rate, options, reader.Frames()));
+		}
+
+		size_t frames;
+		while ((frames = reader.Read(in.data(), STREAM_BLOCK_FRAMES)) > 0) {
+			for (size_t i = 0; i < frames * in_channels; i++) {
+				work[i] = in[i];
+			}
+			for (size_t s = 0; s < stage_count; s++) {
+				RunStage(stages[s], work.data(), frames, measure && s + 1 == stage_count);
+			}
+			if (measure) {
+				continue;
+			}
+			for (size_t i = 0; i < frames * chan_count; i++) {
+				out[i] = (short)work[i];
+			}
+			writer->Write(out.data(), frames);
+		}
+
+		if (measure) {
+			StreamStage& st = stages[reverbs[pass]];
+			for (int ch = 0; ch < st.channels; ch++) {
+				st.gains[ch] = ReverbGain(st.peaks[ch]);
+			}
+		}
+		else {
+			writer->Close();
+			stats = writer->Stats();
+		}
+	}
+	return stats;
+}
+
+JobReport RunJob(const std::string& input, const std::string& output,
+	const std::vector<std::string>& ops, JobBudget& budget, JobScratch& scratch)
+{
+	// Banks are only referenced while a job runs, so dropping them all here is safe.
+	// A job adds at most one bank per op.
+	if (scratch.filters.size() + ops.size() > JobScratch::MAX_CACHED_FILTERS) {
+		scratch.filters.clear();
+	}
+	long long heap_before = ThreadHeapInUse();
+	ResetThreadHeapPeak();
+
+	WriteOptions options;
+	std::vector<JobOp> parsed = ParseOps(ops, options);
+
+	// Only the header is read here; nothing big is allocated before a mode is reserved.
+	wav_header_s head;
+	{
+		WavBlockReader reader(input);
+		head = reader.Header();
+	}
+	PeakEstimate e = EstimatePeak(head, parsed);
+
+	JobReport report;
+	report.input_bytes = head.subchunk2Size;
+	if (budget.TryReserve(e.in_memory)) {
+		report.mode = LOAD_IN_MEMORY;
+		report.reserved_bytes = e.in_memory;
+	}
+	else if (budget.TryReserve(e.mmap)) {
+		report.mode = LOAD_MMAP;
+		report.reserved_bytes = e.mmap;
+	}
+	else if (e.streamable && budget.TryReserve(e.streaming)) {
+		report.mode = LOAD_STREAMING;
+		report.reserved_bytes = e.streaming;
+	}
+	else {
+		throw Memory_Exception("Job needs " + std::to_string(e.streamable ? e.streaming : e.mmap) +
+			" bytes, only " + std::to_string(budget.Available()) + " are available.\n");
+	}
+
+	if (report.mode == LOAD_STREAMING) {
+		report.write = RunStreaming(input, output, parsed, scratch, options);
+	}
+	else {
+		Wav w(input, report.mode);
+		ApplyOps(w, parsed, scratch.filters);
+		if (report.mode == LOAD_MMAP) {
+			report.write = w.MakeWavFileBlocks(output, options);
+		}
+		else {
+			report.write = w.MakeWavFile(output, options);
+		}
+	}
+	report.measured_peak_bytes = (size_t)std::max(0LL, ThreadHeapPeak() - heap_before);
+	return report;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "biquad.h"
+#include "budget.h"
+#include "wav_writer.h"
+#include "WavExceptions.h"
+
+// Filter banks reused between jobs, keyed by operation, cutoff, channels and sample rate.
+typedef std::map<std::string, std::unique_ptr<BiquadBank>> FilterCache;
+
+// State a worker keeps between jobs, so repeated jobs don't set it up again.
+// Whole-signal buffers are not kept: between jobs they would hold memory the budget
+// no longer accounts for.
+struct JobScratch {
+	// Trimmed by RunJob before it grows past MAX_CACHED_FILTERS.
+	FilterCache filters;
+	// Streaming blocks, they keep their capacity from one job to the next.
+	std::vector<short> in;
+	std::vector<float> work;
+	std::vector<short> out;
+
+	static const size_t MAX_CACHED_FILTERS = 64;
+};
+
+struct JobReport {
+	LoadMode mode = LOAD_IN_MEMORY;
+	size_t input_bytes = 0;
+	// Estimated peak of the chosen mode, reserved in the budget for the whole job.
+	size_t reserved_bytes = 0;
+	// Measured peak of the job's heap allocations on its thread (see ThreadHeapPeak).
+	size_t measured_peak_bytes = 0;
+	// How writing the output went, for tuning the write options.
+	WriteStats write;
+};
+
+// Runs 'ops' (mono, reverb:<delay>:<decay>, resample:<rate>, highpass:<hz>, lowpass:<hz>, strip)
+// on 'input' and writes 'output'. The words sync, direct and noprealloc among the ops set
+// the WriteOptions of the output instead. The peak memory of every load mode is estimated from the
+// header's subchunk2Size and the fastest mode that still fits 'budget' is reserved and used:
+// in-memory, then mmap, then block streaming. Streaming supports mono, filters and reverb;
+// a job that fits none of the modes throws Memory_Exception before allocating anything.
+JobReport RunJob(const std::string& input, const std::string& output,
+	const std::vector<std::string>& ops, JobBudget& budget, JobScratch& scratch);
@@ -1,11 +1,117 @@
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 #include "wav.h"
+#include "daemon.h"
+#include "fingerprint.h"
+#include "mixer.h"
+#include "realtime.h"
+#include "wav_stream.h"
 
 using namespace std;
 
 int main(int argc, char *argv[]) {
 	try {
+		// OOP_lab3 --daemon <socket> [workers] [queue] [memory_mb] [job_memory_mb]
+		if (argc >= 3 && std::string(argv[1]) == "--daemon") {
+			int workers = argc >= 4 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+			size_t queue_capacity = argc >= 5 ? (size_t)atoi(argv[4]) : 64;
+			size_t memory_mb = argc >= 6 ? (size_t)atoll(argv[5]) : 1024;
+			size_t job_memory_mb = argc >= 7 ? (size_t)atoll(argv[6]) : memory_mb;
+			WavDaemon daemon(argv[2], workers > 0 ? workers : 1, queue_capacity, memory_mb << 20, job_memory_mb << 20);
+			daemon.Run();
+			return 0;
+		}
+		// OOP_lab3 --rt-bench <file> [block_frames] [paced]
+		if (argc >= 3 && std::string(argv[1]) == "--rt-bench") {
+			RealtimeConfig config;
+			{
+				WavBlockReader reader(argv[2]);
+				config.channels = reader.Channels();
+				config.sample_rate = reader.SampleRate();
+			}
+			config.block_frames = argc >= 4 ? (size_t)atoi(argv[3]) : 256;
+			config.reverb_delay = 0.25;
+			config.reverb_decay = 0.5f;
+			config.gain = 0.5f;
+			RealtimeEngine engine(config);
+			RealtimeStats stats = RunRealtimeSession(argv[2], engine, argc >= 5 && atoi(argv[4]) != 0);
+			printf("blocks %zu, deadline %.1f us, worst %.2f us, mean %.2f us, misses %zu, underruns %zu\n",
+				stats.blocks, stats.deadline_us, stats.worst_us, stats.MeanUs(), stats.deadline_misses, stats.underruns);
+			return stats.deadline_misses == 0 ? 0 : 1;
+		}
+		// OOP_lab3 --segments <file> <json> [stripped_output]
+		if (argc >= 4 && std::string(argv[1]) == "--segments") {
+			Wav w(argv[2]);
+			vector<ActivitySegment> segments = w.DetectActivity();
+			SaveSegmentsJson(segments, w.GetSampleRate(), argv[3]);
+			printf("%zu active segments\n", segments.size());
+			if (argc >= 5) {
+				w.StripSilence(segments);
+				w.MakeWavFile(argv[4]);
+			}
+			return 0;
+		}
+		// OOP_lab3 --fingerprint <index> <query> [library_file ...]
+		// Builds and saves the index when library files are given, loads it otherwise.
+		if (argc >= 4 && std::string(argv[1]) == "--fingerprint") {
+			FingerprintIndex index;
+			if (argc >= 5) {
+				vector<string> failed = index.AddFiles(vector<string>(argv + 4, argv + argc),
+					(int)std::thread::hardware_concurrency());
+				for (size_t i = 0; i < failed.size(); i++) {
+					printf("can't read %s\n", failed[i].c_str());
+				}
+				index.Save(argv[2]);
+			}
+			else {
+				index.Load(argv[2]);
+			}
+			vector<FingerprintMatch> matches = index.Query(FingerprintFile(argv[3]), 5);
+			for (size_t i = 0; i < matches.size(); i++) {
+				printf("%s: score %zu, similarity %.3f, at %.2f s\n", matches[i].name.c_str(),
+					matches[i].score, matches[i].similarity, matches[i].offset_seconds);
+			}
+			return matches.empty() ? 1 : 0;
+		}
+		// OOP_lab3 --mix <output> [--parallel] [--direct] [--sync] [--no-prealloc] <file[:offset[:gain[:pan[:segments.json]]]]> ...
+		if (argc >= 4 && std::string(argv[1]) == "--mix") {
+			StreamMixer mixer;
+			bool parallel = false;
+			WriteOptions options;
+			for (int i = 3; i < argc; i++) {
+				std::string arg = argv[i];
+				if (arg == "--parallel" || arg == "--direct" || arg == "--sync" || arg == "--no-prealloc") {
+					parallel = parallel || arg == "--parallel";
+					options.direct_io = options.direct_io || arg == "--direct";
+					options.sync = options.sync || arg == "--sync";
+					options.preallocate = options.preallocate && arg != "--no-prealloc";
+					continue;
+				}
+				vector<string> parts;
+				std::istringstream in(argv[i]);
+				string part;
+				while (std::getline(in, part, ':')) {
+					parts.push_back(part);
+				}
+				MixTrack track;
+				track.filename = parts[0];
+				track.offset_seconds = parts.size() > 1 ? atof(parts[1].c_str()) : 0.0;
+				track.gain = parts.size() > 2 ? (float)atof(parts[2].c_str()) : 1.0f;
+				track.pan = parts.size() > 3 ? (float)atof(parts[3].c_str()) : 0.0f;
+				if (parts.size() > 4) {
+					// Written by --segments; lets the mixer skip the track's silent blocks unread.
+					track.active = LoadSegmentsJson(parts[4], WavBlockReader(track.filename).SampleRate());
+				}
+				mixer.AddTrack(track);
+			}
+			size_t frames = mixer.Mix(argv[2], parallel, options);
+			const WriteStats& ws = mixer.LastWrite();
+			printf("%zu frames mixed, %zu bytes written in %.3f s, %.1f MB/s%s\n", frames, ws.bytes, ws.seconds,
+				ws.MegabytesPerSecond(), ws.direct_io ? " (direct I/O)" : "");
+			return 0;
+		}
 		Wav w("../wav_example/mono.wav");
 		w.PrintInfo();
 		w.MakeReverb(0.500, 0.6f);
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mixer.h"
+#include "wav_stream.h"
+
+// acc[2 * i + c] += gain[c] * in[i], 'in' is mono, 'acc' is interleaved stereo.
+static void MixMono(float* acc, const short* in, size_t frames, float gl, float gr)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	__m128 g = _mm_setr_ps(gl, gr, gl, gr);
+	for (; i + 4 <= frames; i += 4) {
+		__m128i x = _mm_loadl_epi64((const __m128i*)(in + i));
+		// Duplicate every sample into a (left, right) pair.
+		__m128i pairs = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128 v = _mm_cvtepi32_ps(pairs);
+		__m128 lo = _mm_unpacklo_ps(v, v);
+		__m128 hi = _mm_unpackhi_ps(v, v);
+		_mm_storeu_ps(acc + 2 * i, _mm_add_ps(_mm_loadu_ps(acc + 2 * i), _mm_mul_ps(lo, g)));
+		_mm_storeu_ps(acc + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(acc + 2 * i + 4), _mm_mul_ps(hi, g)));
+	}
+#endif
+	for (; i < frames; i++) {
+		acc[2 * i] += gl * in[i];
+		acc[2 * i + 1] += gr * in[i];
+	}
+}
+
+// acc[2 * i + c] += gain[c] * in[2 * i + c], both interleaved stereo.
+static void MixStereo(float* acc, const short* in, size_t frames, float gl, float gr)
+{
+	size_t i = 0;
+	size_t samples = frames * 2;
+#if defined(__SSE2__)
+	__m128 g = _mm_setr_ps(gl, gr, gl, gr);
+	for (; i + 8 <= samples; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(lo, g)));
+		_mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(hi, g)));
+	}
+#endif
+	for (; i < samples; i++) {
+		acc[i] += (i % 2 ? gr : gl) * in[i];
+	}
+}
+
+// Rounds and saturates floats to shorts.
+static void ToInt16(const float* acc, short* out, size_t samples)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 8 <= samples; i += 8) {
+		__m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(acc + i));
+		__m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(acc + i + 4));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < samples; i++) {
+		float v = acc[i];
+		if (v > 32767.0f) v = 32767.0f;
+		if (v < -32768.0f) v = -32768.0f;
+		out[i] = (short)lrintf(v);
+	}
+}
+
+struct TrackState {
+	std::unique_ptr<WavBlockReader> reader;
+	const MixTrack* track;
+	size_t start;
+	float gl, gr;
+	std::vector<short> buffer;
+	// Part of the current output block covered by this track.
+	size_t dest_offset;
+	size_t count;
+};
+
+// Reads the part of output block [block_begin, block_end) that belongs to 'ts'.
+static void ReadBlock(TrackState& ts, size_t block_begin, size_t block_end)
+{
+	ts.count = 0;
+	size_t track_end = ts.start + ts.reader->Frames();
+	size_t begin = std::max(block_begin, ts.start);
+	size_t end = std::min(block_end, track_end);
+	if (begin >= end) {
+		return;
+	}
+
+	size_t src_begin = begin - ts.start;
+	size_t src_end = end - ts.start;
+	if (!ts.track->active.empty() && !IsRangeActive(ts.track->active, src_begin, src_end)) {
+		ts.reader->Seek(src_end);
+		return;
+	}
+	if (ts.reader->Position() != src_begin) {
+		ts.reader->Seek(src_begin);
+	}
+	ts.dest_offset = begin - block_begin;
+	ts.count = ts.reader->Read(ts.buffer.data(), src_end - src_begin);
+}
+
+// One persistent reader thread per track. Each ReadAll() hands every thread the next
+// output block and waits until all of them have read their part, so threads are
+// started once per mix instead of once per block.
+class TrackReaders {
+public:
+	TrackReaders(std::vector<TrackState>& tracks)
+		: states(tracks), generation(0), pending(0), stopping(false), errors(tracks.size()) {
+		for (size_t t = 0; t < states.size(); t++) {
+			threads.push_back(std::thread(&TrackReaders::Loop, this, t));
+		}
+	}
+	~TrackReaders() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		has_block.notify_all();
+		for (size_t t = 0; t < threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+
+	void ReadAll(size_t begin, size_t end) {
+		std::unique_lock<std::mutex> lock(mutex);
+		block_begin = begin;
+		block_end = end;
+		pending = states.size();
+		generation++;
+		has_block.notify_all();
+		block_done.wait(lock, [this]() { return pending == 0; });
+		for (size_t t = 0; t < errors.size(); t++) {
+			if (errors[t]) {
+				std::rethrow_exception(errors[t]);
+			}
+		}
+	}
+private:
+	void Loop(size_t t) {
+		size_t seen = 0;
+		for (;;) {
+			std::unique_lock<std::mutex> lock(mutex);
+			has_block.wait(lock, [this, seen]() { return generation != seen || stopping; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+			size_t begin = block_begin, end = block_end;
+			lock.unlock();
+
+			try {
+				ReadBlock(states[t], begin, end);
+			}
+			catch (...) {
+				errors[t] = std::current_exception();
+			}
+
+			lock.lock();
+			if (--pending == 0) {
+				block_done.notify_one();
+			}
+		}
+	}
+
+	std::vector<TrackState>& states;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable has_block;
+	std::condition_variable block_done;
+	// Guarded by 'mutex'.
+	size_t generation;
+	size_t block_begin, block_end;
+	size_t pending;
+	bool stopping;
+	std::vector<std::exception_ptr> errors;
+};
+
+StreamMixer::StreamMixer(size_t frames) : block_frames(frames) {
+	if (block_frames == 0) {
+		throw Parameters_Exception("Block size must be positive.\n");
+	}
+}
+
+void StreamMixer::AddTrack(const MixTrack& track) {
+	if (track.offset_seconds < 0.0 || track.pan < -1.0f || track.pan > 1.0f) {
+		throw Parameters_Exception("Track offset must be non-negative and pan must lie in [-1, 1].\n");
+	}
+	tracks.push_back(track);
+}
+
+size_t StreamMixer::Mix(const std::string& filename, bool parallel_read, const WriteOptions& options) {
+	if (tracks.empty()) {
+		throw Parameters_Exception("Nothing to mix.\n");
+	}
+
+	std::vector<TrackState> states(tracks.size());
+	int sample_rate = 0;
+	size_t total_frames = 0;
+	for (size_t t = 0; t < tracks.size(); t++) {
+		TrackState& ts = states[t];
+		ts.track = &tracks[t];
+		ts.reader.reset(new WavBlockReader(tracks[t].filename));
+
+		int chan_count = ts.reader->Channels();
+		if (chan_count != 1 && chan_count != 2) {
+			throw Parameters_Exception("Can't mix " + std::to_string(chan_count) + " channel track " + tracks[t].filename + "\n");
+		}
+		if (t == 0) {
+			sample_rate = ts.reader->SampleRate();
+		}
+		else if (ts.reader->SampleRate() != sample_rate) {
+			throw Parameters_Exception("Track " + tracks[t].filename + " has a different sample rate.\n");
+		}
+
+		float pan = tracks[t].pan;
+		if (chan_count == 1) {
+			double angle = (pan + 1.0) * 3.14159265358979323846 / 4.0;
+			ts.gl = tracks[t].gain * (float)cos(angle);
+			ts.gr = tracks[t].gain * (float)sin(angle);
+		}
+		else {
+			ts.gl = tracks[t].gain * std::min(1.0f, 1.0f - pan);
+			ts.gr = tracks[t].gain * std::min(1.0f, 1.0f + pan);
+		}
+
+		ts.start = (size_t)(tracks[t].offset_seconds * sample_rate);
+		ts.buffer.resize(block_frames * chan_count);
+		total_frames = std::max(total_frames, ts.start + ts.reader->Frames());
+	}
+
+	WavBlockWriter writer(filename, 2, sample_rate, options, total_frames);
+	std::vector<float> acc(block_frames * 2);
+	std::vector<short> out(block_frames * 2);
+	std::unique_ptr<TrackReaders> readers;
+	if (parallel_read) {
+		readers.reset(new TrackReaders(states));
+	}
+
+	for (size_t begin = 0; begin < total_frames; begin += block_frames) {
+		size_t end = std::min(begin + block_frames, total_frames);
+
+		if (readers) {
+			readers->ReadAll(begin, end);
+		}
+		else {
+			for (size_t t = 0; t < states.size(); t++) {
+				ReadBlock(states[t], begin, end);
+			}
+		}
+
+		std::fill(acc.begin(), acc.end(), 0.0f);
+		for (size_t t = 0; t < states.size(); t++) {
+			TrackState& ts = states[t];
+			if (ts.count == 0) {
+				continue;
+			}
+			float* dest = acc.data() + 2 * ts.dest_offset;
+			if (ts.reader->Channels() == 1) {
+				MixMono(dest, ts.buffer.data(), ts.count, ts.gl, ts.gr);
+			}
+			else {
+				MixStereo(dest, ts.buffer.data(), ts.count, ts.gl, ts.gr);
+			}
+		}
+
+		ToInt16(acc.data(), out.data(), (end - begin) * 2);
+		writer.Write(out.data(), end - begin);
+	}
+	writer.Close();
+	last_write = writer.Stats();
+	return writer.Frames();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "activity.h"
+#include "wav_writer.h"
+#include "WavExceptions.h"
+
+struct MixTrack {
+	std::string filename;
+	// Where the track starts in the mix.
+	double offset_seconds = 0.0;
+	float gain = 1.0f;
+	// -1 is hard left, 1 is hard right. Mono tracks use a constant-power pan law,
+	// stereo tracks are balanced.
+	float pan = 0.0f;
+	// Optional result of DetectActivity for this file; blocks outside it are skipped unread.
+	std::vector<ActivitySegment> active;
+};
+
+// Sums any number of mono or stereo WAV files into one stereo file.
+// Inputs are read and the output is written block by block, so memory
+// is proportional to tracks * block size, not to the length of the mix.
+class StreamMixer {
+public:
+	StreamMixer(size_t block_frames = 4096);
+
+	void AddTrack(const MixTrack& track);
+	// Renders the mix to 'filename' and returns the number of frames written.
+	// With 'parallel_read' every track reads its blocks on its own thread, started once per mix.
+	size_t Mix(const std::string& filename, bool parallel_read, const WriteOptions& options = WriteOptions());
+	// How writing the last mix went.
+	const WriteStats& LastWrite() const { return last_write; }
+private:
+	size_t block_frames;
+	std::vector<MixTrack> tracks;
+	WriteStats last_write;
+};
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "realtime.h"
+#include "spsc_ring.h"
+#include "wav_stream.h"
+
+using namespace std::chrono;
+
+RealtimeEngine::RealtimeEngine(const RealtimeConfig& cfg) : config(cfg), delay_pos(0) {
+	if (config.channels < 1 || config.block_frames == 0 || config.sample_rate < 1) {
+		throw Parameters_Exception("Bad real-time engine configuration.\n");
+	}
+	out_channels = config.mono ? 1 : config.channels;
+	delay_samples = (size_t)(config.reverb_delay * config.sample_rate);
+	delay_lines.assign(delay_samples * out_channels, 0.0f);
+	work.assign(config.block_frames * out_channels, 0.0f);
+	ResetStats();
+}
+
+void RealtimeEngine::ResetStats() {
+	stats = RealtimeStats();
+	stats.deadline_us = 1e6 * config.block_frames / config.sample_rate;
+}
+
+void RealtimeEngine::ProcessBlock(const short* in, short* out) {
+	steady_clock::time_point start = steady_clock::now();
+
+	size_t frames = config.block_frames;
+	int chan_count = config.channels;
+
+	// Convert to float, downmixing if requested.
+	if (config.mono) {
+		float scale = 1.0f / chan_count;
+		for (size_t i = 0; i < frames; i++) {
+			float sum = 0.0f;
+			for (int ch = 0; ch < chan_count; ch++) {
+				sum += in[i * chan_count + ch];
+			}
+			work[i] = sum * scale;
+		}
+	}
+	else {
+		for (size_t i = 0; i < frames * chan_count; i++) {
+			work[i] = in[i];
+		}
+	}
+
+	// y[n] = x[n] + decay * y[n - delay], the same recursion as Wav::MakeReverb.
+	if (delay_samples > 0) {
+		for (size_t i = 0; i < frames; i++) {
+			float* history = &delay_lines[delay_pos * out_channels];
+			for (int ch = 0; ch < out_channels; ch++) {
+				float y = work[i * out_channels + ch] + config.reverb_decay * history[ch];
+				history[ch] = y;
+				work[i * out_channels + ch] = y;
+			}
+			if (++delay_pos == delay_samples) {
+				delay_pos = 0;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < frames * out_channels; i++) {
+		float v = work[i] * config.gain;
+		if (v > 32767.0f) v = 32767.0f;
+		if (v < -32768.0f) v = -32768.0f;
+		out[i] = (short)v;
+	}
+
+	double elapsed_us = duration<double, std::micro>(steady_clock::now() - start).count();
+	stats.blocks++;
+	stats.total_us += elapsed_us;
+	if (elapsed_us > stats.worst_us) {
+		stats.worst_us = elapsed_us;
+	}
+	if (elapsed_us > stats.deadline_us) {
+		stats.deadline_misses++;
+	}
+}
+
+RealtimeStats RunRealtimeSession(const std::string& filename, RealtimeEngine& engine, bool paced)
+{
+	WavBlockReader reader(filename);
+	if (reader.Channels() != engine.InputChannels()) {
+		throw Parameters_Exception("Engine expects " + std::to_string(engine.InputChannels()) + " channels.\n");
+	}
+
+	size_t block_samples = engine.BlockFrames() * reader.Channels();
+	// Enough room for a few blocks of read-ahead.
+	SpscRing<short> ring(block_samples * 8);
+	std::atomic<bool> done(false);
+	std::atomic<bool> failed(false);
+
+	std::thread producer([&]() {
+		std::vector<short> block(block_samples);
+		try {
+			size_t got;
+			while ((got = reader.Read(block.data(), engine.BlockFrames())) > 0) {
+				// Zero-pad the last, incomplete block.
+				std::fill(block.begin() + got * reader.Channels(), block.end(), 0);
+				while (!ring.Push(block.data(), block_samples)) {
+					std::this_thread::yield();
+				}
+			}
+		}
+		catch (WavException&) {
+			failed = true;
+		}
+		done = true;
+	});
+
+	std::vector<short> in(block_samples);
+	std::vector<short> out(engine.BlockFrames() * engine.OutputChannels());
+	engine.ResetStats();
+	size_t underruns = 0;
+
+	microseconds period((long long)engine.Stats().deadline_us);
+	steady_clock::time_point next = steady_clock::now();
+	for (;;) {
+		if (paced) {
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+		bool missed = false;
+		bool have = ring.Pop(in.data(), block_samples);
+		while (!have) {
+			if (done) {
+				// 'done' is set after the last push, so one more attempt sees everything.
+				have = ring.Pop(in.data(), block_samples);
+				break;
+			}
+			missed = true;
+			std::this_thread::yield();
+			have = ring.Pop(in.data(), block_samples);
+		}
+		if (!have) {
+			break;
+		}
+		if (missed) {
+			underruns++;
+		}
+		engine.ProcessBlock(in.data(), out.data());
+	}
+	producer.join();
+	if (failed) {
+		throw Format_Exception("Reading " + filename + " failed during real-time session.\n");
+	}
+
+	RealtimeStats stats = engine.Stats();
+	stats.underruns = paced ? underruns : 0;
+	return stats;
+}
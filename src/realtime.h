@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "WavExceptions.h"
+
+struct RealtimeConfig {
+	int channels = 2;
+	int sample_rate = 44100;
+	size_t block_frames = 256;
+	// Downmix all input channels to one, like Wav::MakeMono.
+	bool mono = false;
+	// Feedback reverb, like Wav::MakeReverb. Disabled when delay is 0.
+	double reverb_delay = 0.0;
+	float reverb_decay = 0.0f;
+	// Whole-file normalization is impossible in real time, so a fixed output gain is used instead.
+	float gain = 1.0f;
+};
+
+struct RealtimeStats {
+	size_t blocks = 0;
+	size_t deadline_misses = 0;
+	size_t underruns = 0;
+	double deadline_us = 0.0;
+	double worst_us = 0.0;
+	double total_us = 0.0;
+
+	double MeanUs() const { return blocks ? total_us / blocks : 0.0; }
+};
+
+// Processes fixed-size blocks of interleaved 16-bit frames.
+// All state is allocated in the constructor; ProcessBlock does no allocation, locking or I/O.
+class RealtimeEngine {
+public:
+	RealtimeEngine(const RealtimeConfig& config);
+
+	int InputChannels() const { return config.channels; }
+	int OutputChannels() const { return out_channels; }
+	size_t BlockFrames() const { return config.block_frames; }
+
+	// 'in' holds block_frames * channels samples, 'out' receives block_frames * OutputChannels().
+	void ProcessBlock(const short* in, short* out);
+
+	const RealtimeStats& Stats() const { return stats; }
+	void ResetStats();
+private:
+	RealtimeConfig config;
+	int out_channels;
+	size_t delay_samples;
+	size_t delay_pos;
+	// Per output channel circular history of delay_samples outputs.
+	std::vector<float> delay_lines;
+	std::vector<float> work;
+	RealtimeStats stats;
+};
+
+// Feeds 'filename' through 'engine' the way a live service would: a reader thread pushes
+// blocks into a lock-free ring and the processing thread pops and processes them.
+// When 'paced' is set the processing thread waits for each block period, so ring underruns
+// are counted; otherwise blocks are processed back to back to measure per-block latency.
+RealtimeStats RunRealtimeSession(const std::string& filename, RealtimeEngine& engine, bool paced);
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+// Lock-free single-producer/single-consumer ring buffer.
+// Storage is allocated once in the constructor; Push and Pop never allocate or block.
+// Exactly one thread may call Push and exactly one other thread may call Pop.
+template <typename T>
+class SpscRing {
+public:
+	SpscRing(size_t min_capacity) : head(0), tail(0) {
+		size_t capacity = 1;
+		while (capacity < min_capacity) {
+			capacity <<= 1;
+		}
+		buffer.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	size_t Capacity() const { return buffer.size(); }
+	size_t Size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+	// Pushes all 'count' items or nothing. Returns false when there is no room.
+	bool Push(const T* items, size_t count) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t t = tail.load(std::memory_order_acquire);
+		if (buffer.size() - (h - t) < count) {
+			return false;
+		}
+		for (size_t i = 0; i < count; i++) {
+			buffer[(h + i) & mask] = items[i];
+		}
+		head.store(h + count, std::memory_order_release);
+		return true;
+	}
+
+	// Pops exactly 'count' items or nothing. Returns false when not enough items are queued.
+	bool Pop(T* items, size_t count) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t h = head.load(std::memory_order_acquire);
+		if (h - t < count) {
+			return false;
+		}
+		for (size_t i = 0; i < count; i++) {
+			items[i] = buffer[(t + i) & mask];
+		}
+		tail.store(t + count, std::memory_order_release);
+		return true;
+	}
+private:
+	std::vector<T> buffer;
+	size_t mask;
+	// Producer and consumer indices live on separate cache lines to avoid false sharing.
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
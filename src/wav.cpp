@@ -1,12 +1,34 @@
+#include <algorithm>
+#include <cmath>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "wav.h"
+#include "wav_stream.h"
 
-Wav::Wav(const string &filename) {
+Wav::Wav(const string &filename, LoadMode mode) {
+	if (mode == LOAD_STREAMING) {
+		throw Parameters_Exception("Wav keeps all samples in memory, stream with WavBlockReader instead.\n");
+	}
 	f = fopen(filename.c_str(), "rb");
 	if (f == NULL) {
 		throw IO_Exception("No such file");
 	}
-	ReadHeader();
-	ExtractDataInt16();
+	// The destructor won't run for a half-built object, so don't leak the file on a bad header.
+	try {
+		ReadHeader();
+		if (mode == LOAD_MMAP) {
+			ExtractDataMmap();
+		}
+		else {
+			ExtractDataInt16();
+		}
+	}
+	catch (...) {
+		fclose(f);
+		throw;
+	}
 }
 Wav::~Wav() {
 	fclose(f);
@@ -69,6 +91,10 @@ void Wav::CheckHeader() {
 		throw Header_Exception("HEADER_SUBCHUNK1_ERROR\n");
 	}
 
+	if (head.numChannels < 1 || head.sampleRate < 1) {
+		throw Header_Exception("HEADER_CHANNELS_OR_RATE_ERROR\n");
+	}
+
 	if (head.byteRate != head.sampleRate * head.numChannels * head.bitsPerSample / 8) {
 		throw Header_Exception("HEADER_BYTES_RATE_ERROR\n");
 	}
@@ -105,6 +131,12 @@ void Wav::PrintInfo() {
 	printf(" subchunk2Size %u\n", head.subchunk2Size);
 	printf("-------------------------\n");
 }
+const vector<vector<short>>& Wav::GetChannelsData() const {
+	return channels_data;
+}
+int Wav::GetSampleRate() const {
+	return head.sampleRate;
+}
 
 void Wav::HeadRefactor(int chan_count, int sample_rate, int samples_count_per_chan) {
 
@@ -152,8 +184,45 @@ void Wav::ExtractDataInt16()
 	}
 	fseek(f, 0, SEEK_SET);
 }
+void Wav::ExtractDataMmap()
+{
+	int chan_count = head.numChannels;
+	size_t samples_per_chan = (head.subchunk2Size / sizeof(short)) / chan_count;
+	size_t file_bytes = 44 + head.subchunk2Size;
+
+	// Deinterleave straight from the page cache, without the interleaved copy ExtractDataInt16 makes.
+	void* map = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if (map == MAP_FAILED) {
+		throw Format_Exception("Can't map PCM data.\n");
+	}
+	madvise(map, file_bytes, MADV_SEQUENTIAL);
+	const short* all_channels = (const short*)((const char*)map + 44);
+
+	channels_data.resize(chan_count);
+	for (int ch = 0; ch < chan_count; ch++) {
+		channels_data[ch].resize(samples_per_chan);
+	}
+
+	// Go chunk by chunk and drop the pages behind us, so mapped pages don't add up in RSS.
+	const size_t chunk_frames = 1 << 16;
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	for (size_t begin = 0; begin < samples_per_chan; begin += chunk_frames) {
+		size_t end = std::min(begin + chunk_frames, samples_per_chan);
+		for (size_t i = begin; i < end; i++) {
+			for (int ch = 0; ch < chan_count; ch++) {
+				channels_data[ch][i] = all_channels[chan_count * i + ch];
+			}
+		}
+		size_t done_bytes = (44 + end * chan_count * sizeof(short)) / page * page;
+		madvise(map, done_bytes, MADV_DONTNEED);
+	}
+	munmap(map, file_bytes);
+}
 
 void Wav::MakeWavFile(const std::string filename) {
+	MakeWavFile(filename, WriteOptions());
+}
+WriteStats Wav::MakeWavFile(const std::string filename, const WriteOptions& options) {
 	//printf(">>>> make_wav_file( %s )\n", filename);
 
 	int chan_count = head.numChannels;
@@ -177,13 +246,7 @@ void Wav::MakeWavFile(const std::string filename) {
 		}
 	}
 
-	FILE* nf = fopen(filename.c_str(), "wb");
-	if (nf == NULL) {
-		throw ("Can't create/write to file.\n");
-	}
-	fwrite(&head, sizeof(wav_header_s), 1, nf);
-	fwrite(all_channels.data(), sizeof(short), all_channels.size(), nf);
-	fclose(nf);
+	return WriteWavFile(filename, head, all_channels.data(), all_channels.size(), options);
 }
 
 void Wav::MakeMono()
@@ -245,13 +308,13 @@ void Wav::MakeReverb(double delay_seconds, float decay)
 		}
 
 		// Add a reverb
-		for (size_t i = 0; i < samples_count_per_chan - delay_samples; i++) {
+		for (int i = 0; i < samples_count_per_chan - delay_samples; i++) {
 			tmp[i + delay_samples] += decay * tmp[i];
 		}
 
 		// Find maximum signal's magnitude
 		float max_magnitude = 0.0f;
-		for (size_t i = 0; i < samples_count_per_chan - delay_samples; i++) {
+		for (int i = 0; i < samples_count_per_chan - delay_samples; i++) {
 			if (abs(tmp[i]) > max_magnitude) {
 				max_magnitude = abs(tmp[i]);
 			}
@@ -260,12 +323,195 @@ void Wav::MakeReverb(double delay_seconds, float decay)
 		// Signed short can keep values from -32768 to +32767,
 		// After reverb, usually there are values large 32000.
 		// So we must scale all values back to [ -32768 ... 32768 ]
-		float norm_coef = 30000.0f / max_magnitude;
+		float norm_coef = ReverbGain(max_magnitude);
 		printf("max_magnitude = %.1f, coef = %.3f\n", max_magnitude, norm_coef);
 
-		// Scale back and transform floats to shorts.
+		// Scale back and transform floats to shorts. The tail after the peak window
+		// can still overshoot, so saturate.
 		for (size_t i = 0; i < samples_count_per_chan; i++) {
-			channels_data[ch][i] = (short)(norm_coef * tmp[i]);
+			float v = norm_coef * tmp[i];
+			if (v > 32767.0f) v = 32767.0f;
+			if (v < -32768.0f) v = -32768.0f;
+			channels_data[ch][i] = (short)v;
+		}
+	}
+}
+float ReverbGain(float max_magnitude)
+{
+	// A silent channel stays silent instead of being scaled by infinity.
+	return max_magnitude > 0.0f ? 30000.0f / max_magnitude : 1.0f;
+}
+vector<ActivitySegment> Wav::DetectActivity(const ActivityParams& params)
+{
+	return ::DetectActivity(channels_data, head.sampleRate, params);
+}
+void Wav::TrimSilence(const vector<ActivitySegment>& segments)
+{
+	// Cut leading and trailing silence only, pauses inside are kept.
+	vector<ActivitySegment> outer;
+	if (!segments.empty()) {
+		outer.push_back({ segments.front().begin, segments.back().end });
+	}
+	KeepSegments(outer);
+}
+void Wav::StripSilence(const vector<ActivitySegment>& segments)
+{
+	KeepSegments(segments);
+}
+void Wav::KeepSegments(const vector<ActivitySegment>& segments)
+{
+	int chan_count = (int)channels_data.size();
+	if (chan_count < 1) {
+		throw Format_Exception("Channel count can't be fewer than 1");
+	}
+
+	size_t samples_count_per_chan = channels_data[0].size();
+	size_t kept = 0;
+	for (size_t s = 0; s < segments.size(); s++) {
+		if (segments[s].begin > segments[s].end || segments[s].end > samples_count_per_chan ||
+			(s > 0 && segments[s].begin < segments[s - 1].end)) {
+			throw Parameters_Exception("Segments must be sorted and lie inside the signal.\n");
+		}
+		kept += segments[s].end - segments[s].begin;
+	}
+
+	// Segments are sorted, so active audio can be compacted in place.
+	for (int ch = 0; ch < chan_count; ch++) {
+		std::vector<short>& chdata = channels_data[ch];
+		size_t pos = 0;
+		for (size_t s = 0; s < segments.size(); s++) {
+			std::copy(chdata.begin() + segments[s].begin, chdata.begin() + segments[s].end, chdata.begin() + pos);
+			pos += segments[s].end - segments[s].begin;
 		}
+		chdata.resize(kept);
+	}
+	HeadRefactor(chan_count, head.sampleRate, (int)kept);
+}
+void Wav::ApplyFilterBank(BiquadBank& bank)
+{
+	int chan_count = (int)channels_data.size();
+	if (chan_count != bank.Channels()) {
+		throw Parameters_Exception("Filter bank is set up for " + std::to_string(bank.Channels()) + " channels.\n");
+	}
+
+	size_t samples_count_per_chan = channels_data[0].size();
+
+	// Verify that all channels have the same number of samples.
+	for (int ch = 0; ch < chan_count; ch++) {
+		if (channels_data[ch].size() != samples_count_per_chan) {
+			throw Format_Exception("Samples per channel differ from channel to channel\n");
+		}
+	}
+
+	// Filter block by block through a small interleaved buffer, the bank keeps its state.
+	const size_t block_frames = 1024;
+	std::vector<float> block(block_frames * chan_count);
+	for (size_t begin = 0; begin < samples_count_per_chan; begin += block_frames) {
+		size_t count = std::min(block_frames, samples_count_per_chan - begin);
+		for (size_t i = 0; i < count; i++) {
+			for (int ch = 0; ch < chan_count; ch++) {
+				block[i * chan_count + ch] = channels_data[ch][begin + i];
+			}
+		}
+		bank.Process(block.data(), count);
+		for (size_t i = 0; i < count; i++) {
+			for (int ch = 0; ch < chan_count; ch++) {
+				float v = block[i * chan_count + ch];
+				if (v > 32767.0f) v = 32767.0f;
+				if (v < -32768.0f) v = -32768.0f;
+				channels_data[ch][begin + i] = (short)v;
+			}
+		}
+	}
+}
+void Wav::Resample(int new_sample_rate)
+{
+	int chan_count = (int)channels_data.size();
+	if (chan_count < 1) {
+		throw Format_Exception("Channel count can't be fewer than 1");
+	}
+	if (new_sample_rate < 1) {
+		throw Parameters_Exception("Sample rate must be positive.\n");
 	}
-}
\ No newline at end of file
+
+	size_t new_count = 0;
+	for (int ch = 0; ch < chan_count; ch++) {
+		std::vector<short> dst = ResampleChannel(channels_data[ch], head.sampleRate, new_sample_rate);
+		new_count = dst.size();
+		channels_data[ch].swap(dst);
+	}
+	HeadRefactor(chan_count, new_sample_rate, (int)new_count);
+}
+std::vector<short> ResampleChannel(const std::vector<short>& src, int sample_rate, int new_sample_rate)
+{
+	if (sample_rate < 1 || new_sample_rate < 1) {
+		throw Parameters_Exception("Sample rate must be positive.\n");
+	}
+
+	// Downsampling folds everything above the new Nyquist frequency back into the band,
+	// so cut it first with an 8th order Butterworth low-pass just below it.
+	const std::vector<short>* input = &src;
+	std::vector<short> filtered;
+	if (new_sample_rate < sample_rate) {
+		const double q[] = { 0.5098, 0.6013, 0.9000, 2.5629 };
+		BiquadBank bank(1, 4);
+		for (int s = 0; s < 4; s++) {
+			bank.SetStage(s, BiquadCoefs::LowPass(sample_rate, 0.45 * new_sample_rate, q[s]));
+		}
+		filtered.resize(src.size());
+		const size_t block_frames = 1024;
+		float block[block_frames];
+		for (size_t begin = 0; begin < src.size(); begin += block_frames) {
+			size_t count = std::min(block_frames, src.size() - begin);
+			for (size_t i = 0; i < count; i++) {
+				block[i] = src[begin + i];
+			}
+			bank.Process(block, count);
+			for (size_t i = 0; i < count; i++) {
+				float v = block[i];
+				if (v > 32767.0f) v = 32767.0f;
+				if (v < -32768.0f) v = -32768.0f;
+				filtered[begin + i] = (short)v;
+			}
+		}
+		input = &filtered;
+	}
+
+	// Linear interpolation between the two nearest source samples.
+	const std::vector<short>& in = *input;
+	size_t new_count = (size_t)((double)in.size() * new_sample_rate / sample_rate);
+	double step = (double)sample_rate / new_sample_rate;
+	std::vector<short> dst(new_count);
+	for (size_t i = 0; i < new_count; i++) {
+		double pos = i * step;
+		size_t k = (size_t)pos;
+		double frac = pos - k;
+		double next = k + 1 < in.size() ? in[k + 1] : in[k];
+		dst[i] = (short)lrint(in[k] + frac * (next - in[k]));
+	}
+	return dst;
+}
+WriteStats Wav::MakeWavFileBlocks(const std::string filename, const WriteOptions& options)
+{
+	int chan_count = (int)channels_data.size();
+	if (chan_count < 1) {
+		throw Format_Exception("Channel count can't be fewer than 1");
+	}
+	size_t samples_count_per_chan = channels_data[0].size();
+
+	// Interleave through a small buffer instead of a second copy of the whole signal.
+	const size_t block_frames = 1 << 14;
+	std::vector<short> block(block_frames * chan_count);
+	WavBlockWriter writer(filename, chan_count, head.sampleRate, options, samples_count_per_chan);
+	for (size_t begin = 0; begin < samples_count_per_chan; begin += block_frames) {
+		size_t count = std::min(block_frames, samples_count_per_chan - begin);
+		for (size_t i = 0; i < count; i++) {
+			for (int ch = 0; ch < chan_count; ch++) {
+				block[i * chan_count + ch] = channels_data[ch][begin + i];
+			}
+		}
+		writer.Write(block.data(), count);
+	}
+	writer.Close();
+	return writer.Stats();
+}
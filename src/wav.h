@@ -4,17 +4,31 @@
 #include <iostream>
 #include "WavExceptions.h"
 #include "wav_header.h"
+#include "activity.h"
+#include "biquad.h"
+#include "wav_writer.h"
+#include "budget.h"
 
 using namespace std;
 class Wav {
 public:
-	Wav(const std::string &filename);
+	Wav(const std::string &filename, LoadMode mode = LOAD_IN_MEMORY);
 	void ReadHeader();
 	void PrintInfo();
+	const vector<vector<short>>& GetChannelsData() const;
+	int GetSampleRate() const;
 	void ExtractDataInt16();
+	void ExtractDataMmap();
 	void MakeWavFile(const std::string filename);
+	WriteStats MakeWavFile(const std::string filename, const WriteOptions& options);
+	WriteStats MakeWavFileBlocks(const std::string filename, const WriteOptions& options = WriteOptions());
 	void MakeMono();
 	void MakeReverb(double delay_seconds, float decay);
+	void Resample(int new_sample_rate);
+	vector<ActivitySegment> DetectActivity(const ActivityParams& params = ActivityParams());
+	void TrimSilence(const vector<ActivitySegment>& segments);
+	void StripSilence(const vector<ActivitySegment>& segments);
+	void ApplyFilterBank(BiquadBank& bank);
 	~Wav();
 private:
 	FILE *f;
@@ -24,4 +38,10 @@ private:
 
 	void HeadRefactor(int chan_count, int sample_rate, int samples_count_per_chan);
 	void CheckHeader();
-};
\ No newline at end of file
+	void KeepSegments(const vector<ActivitySegment>& segments);
+};
+
+// Normalization gain MakeReverb applies to a channel with the given peak magnitude.
+float ReverbGain(float max_magnitude);
+// One channel of Wav::Resample: anti-alias low-pass when downsampling, then linear interpolation.
+std::vector<short> ResampleChannel(const std::vector<short>& src, int sample_rate, int new_sample_rate);
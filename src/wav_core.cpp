@@ -208,7 +208,7 @@ void prefill_header(wav_header_s *header_ptr)
 
 }
 
-wav_errors_e fill_header(wav_header_s *header_ptr, int chan_count, int bits_per_sample, int sample_rate, int samples_count_per_chan)
+wav_errors_e fill_header(wav_header_s *header_ptr, int chan_count, int bits_per_sample, int sample_rate, size_t samples_count_per_chan)
 {
     if ( bits_per_sample != 16 ) {
         return UNSUPPORTED_FORMAT;
@@ -217,16 +217,22 @@ wav_errors_e fill_header(wav_header_s *header_ptr, int chan_count, int bits_per_
     if ( chan_count < 1 ) {
         return BAD_PARAMS;
     }
+
+    // 64-bit arithmetic, so anything past the RIFF limit is refused instead of wrapping.
+    uint64_t data_bytes = (uint64_t)chan_count * (bits_per_sample/8) * samples_count_per_chan;
+    if ( data_bytes > WAV_MAX_DATA_BYTES ) {
+        return BAD_PARAMS;
+    }
     prefill_header( header_ptr );
 
-    int file_size_bytes = 44 + chan_count * (bits_per_sample/8) * samples_count_per_chan;
+    uint64_t file_size_bytes = 44 + data_bytes;
 
     header_ptr->sampleRate    = sample_rate;
     header_ptr->numChannels   = chan_count;
     header_ptr->bitsPerSample = 16;
 
-    header_ptr->chunkSize     = file_size_bytes - 8;
-    header_ptr->subchunk2Size = file_size_bytes - 44;
+    header_ptr->chunkSize     = (uint32_t)(file_size_bytes - 8);
+    header_ptr->subchunk2Size = (uint32_t)(file_size_bytes - 44);
 
     header_ptr->byteRate      = header_ptr->sampleRate * header_ptr->numChannels * header_ptr->bitsPerSample/8;
     header_ptr->blockAlign    = header_ptr->numChannels * header_ptr->bitsPerSample/8;
@@ -1,6 +1,7 @@
 #ifndef WAV_CORE_H
 #define WAV_CORE_H
 
+#include <cstdint>
 #include <vector>
 
 #include "wav_header.h"
@@ -82,8 +83,12 @@ void null_header( wav_header_s* header_ptr );
 // Returns 'WAV_OK' on success.
 wav_headers_errors_e check_header( const wav_header_s* header_ptr, size_t file_size_bytes );
 
+// Largest data chunk whose sizes still fit the 32-bit RIFF header fields.
+const uint64_t WAV_MAX_DATA_BYTES = UINT32_MAX - 36;
+
 // Fills header information, using input parameters. This function calls prefill_header() itself.
-wav_errors_e fill_header( wav_header_s* header_ptr, int chan_count, int bits_per_sample, int sample_rate, int samples_count_per_chan );
+// Returns 'BAD_PARAMS' when the data would exceed WAV_MAX_DATA_BYTES.
+wav_errors_e fill_header( wav_header_s* header_ptr, int chan_count, int bits_per_sample, int sample_rate, size_t samples_count_per_chan );
 
 // Fills 'header_ptr' with default values.
 void prefill_header( wav_header_s* header_ptr );
@@ -1,6 +1,8 @@
 #ifndef WAV_HEADER_H
 #define WAV_HEADER_H
 
+#include <cstdint>
+
 // Got from
 // https://audiocoding.ru/article/2008/05/22/wav-file-structure.html
 //
@@ -23,7 +25,7 @@ struct wav_header_s
     // Это оставшийся размер цепочки, начиная с этой позиции.
     // Иначе говоря, это размер файла - 8, то есть,
     // исключены поля chunkId и chunkSize.
-    unsigned long chunkSize;
+    uint32_t chunkSize;
 
     // Содержит символы "WAVE"
     // (0x57415645 в big-endian представлении)
@@ -38,28 +40,28 @@ struct wav_header_s
 
     // 16 для формата PCM.
     // Это оставшийся размер подцепочки, начиная с этой позиции.
-    unsigned long subchunk1Size;
+    uint32_t subchunk1Size;
 
     // Аудио формат, полный список можно получить здесь http://audiocoding.ru/wav_formats.txt
     // Для PCM = 1 (то есть, Линейное квантование).
     // Значения, отличающиеся от 1, обозначают некоторый формат сжатия.
-    unsigned short audioFormat;
+    uint16_t audioFormat;
 
     // Количество каналов. Моно = 1, Стерео = 2 и т.д.
-    unsigned short numChannels;
+    uint16_t numChannels;
 
     // Частота дискретизации. 8000 Гц, 44100 Гц и т.д.
-    unsigned long sampleRate;
+    uint32_t sampleRate;
 
     // sampleRate * numChannels * bitsPerSample/8
-    unsigned long byteRate;
+    uint32_t byteRate;
 
     // numChannels * bitsPerSample/8
     // Количество байт для одного сэмпла, включая все каналы.
-    unsigned short blockAlign;
+    uint16_t blockAlign;
 
     // Так называемая "глубиная" или точность звучания. 8 бит, 16 бит и т.д.
-    unsigned short bitsPerSample;
+    uint16_t bitsPerSample;
 
     // Подцепочка "data" содержит аудио-данные и их размер.
 
@@ -69,7 +71,7 @@ struct wav_header_s
 
     // numSamples * numChannels * bitsPerSample/8
     // Количество байт в области данных.
-    unsigned long subchunk2Size;
+    uint32_t subchunk2Size;
 
     // Далее следуют непосредственно Wav данные.
 };
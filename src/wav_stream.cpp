@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wav_stream.h"
+#include "wav_core.h"
+#include "wav_writer.h"
+
+WavBlockReader::WavBlockReader(const std::string& filename) : position(0) {
+	f = fopen(filename.c_str(), "rb");
+	if (f == NULL) {
+		throw IO_Exception(filename);
+	}
+	if (fread(&head, sizeof(head), 1, f) != 1) {
+		fclose(f);
+		throw Format_Exception("Head hasn't been read.\n");
+	}
+
+	fseek(f, 0, SEEK_END);
+	size_t file_size = ftell(f);
+	fseek(f, sizeof(head), SEEK_SET);
+
+	if (check_header(&head, file_size) != HEADER_OK) {
+		fclose(f);
+		throw Header_Exception("Bad header in " + filename + "\n");
+	}
+	if (head.bitsPerSample != 16) {
+		fclose(f);
+		throw Header_Exception("Bits per sample must be 16\n");
+	}
+	// check_header accepts zero channels together with a zero block align and byte rate.
+	if (head.numChannels < 1 || head.blockAlign == 0) {
+		fclose(f);
+		throw Header_Exception("Channel count can't be fewer than 1\n");
+	}
+	if (head.sampleRate < 1) {
+		fclose(f);
+		throw Header_Exception("Sample rate must be positive\n");
+	}
+	frames_total = head.subchunk2Size / head.blockAlign;
+}
+WavBlockReader::~WavBlockReader() {
+	fclose(f);
+}
+
+size_t WavBlockReader::Read(short* dest, size_t frames) {
+	if (frames > frames_total - position) {
+		frames = frames_total - position;
+	}
+	size_t read_frames = fread(dest, head.blockAlign, frames, f);
+	position += read_frames;
+	if (read_frames != frames) {
+		throw Format_Exception("PCM data is smaller than it is declared in subchunk2Size.\n");
+	}
+	return read_frames;
+}
+void WavBlockReader::Seek(size_t frame) {
+	if (frame > frames_total) {
+		frame = frames_total;
+	}
+	fseek(f, sizeof(head) + frame * head.blockAlign, SEEK_SET);
+	position = frame;
+}
+
+WavBlockWriter::WavBlockWriter(const std::string& filename, int chan_count, int sample_rate,
+	const WriteOptions& write_options, size_t expected_frames)
+	: fd(-1), name(filename), path(filename), options(write_options), frames_written(0),
+	buffer(NULL), buffered(0) {
+	if (fill_header(&head, chan_count, 16, sample_rate, 0) != WAV_OK) {
+		throw Parameters_Exception("Can't write " + std::to_string(chan_count) + " channels.\n");
+	}
+	if (options.atomic) {
+		fd = CreateTempFile(filename, path);
+	}
+	else {
+		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	}
+	if (fd < 0) {
+		throw Write_Exception(filename);
+	}
+
+	if (options.direct_io) {
+		int direct_fd = open(path.c_str(), O_WRONLY | O_DIRECT);
+		if (direct_fd >= 0) {
+			close(fd);
+			fd = direct_fd;
+			stats.direct_io = true;
+		}
+	}
+	// Over-allocated by one alignment unit, 'buffer' starts at the first aligned byte.
+	storage.resize(WRITE_CHUNK + DIRECT_ALIGN);
+	buffer = storage.data() + (DIRECT_ALIGN - (uintptr_t)storage.data() % DIRECT_ALIGN) % DIRECT_ALIGN;
+	bool ok = true;
+	if (options.preallocate && expected_frames > 0) {
+		ok = Preallocate(fd, sizeof(head) + (uint64_t)expected_frames * head.blockAlign);
+	}
+	if (!ok) {
+		Discard();
+		throw Write_Exception(filename);
+	}
+	// Placeholder, rewritten with the real sizes by Close.
+	memcpy(buffer, &head, sizeof(head));
+	buffered = sizeof(head);
+}
+WavBlockWriter::~WavBlockWriter() {
+	Discard();
+}
+
+void WavBlockWriter::Discard() {
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+		if (options.atomic) {
+			unlink(path.c_str());
+		}
+	}
+	std::vector<char>().swap(storage);
+	buffer = NULL;
+}
+
+bool WavBlockWriter::Flush(size_t bytes) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	struct iovec iov = { buffer, bytes };
+	bool ok = WriteAll(fd, &iov, 1);
+	stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+void WavBlockWriter::Write(const short* frames, size_t count) {
+	if (fd < 0) {
+		throw Write_Exception(name);
+	}
+	// The RIFF sizes are 32-bit; refuse the block that would make them overflow.
+	if ((uint64_t)(frames_written + count) * head.blockAlign > WAV_MAX_DATA_BYTES) {
+		throw Format_Exception("WAV data can't exceed 4 GiB, " + name + " is too long.\n");
+	}
+	// Blocks are gathered into whole chunks, so the file is written in large aligned pieces.
+	const char* data = (const char*)frames;
+	size_t left = count * head.blockAlign;
+	while (left > 0) {
+		size_t n = std::min(left, WRITE_CHUNK - buffered);
+		memcpy(buffer + buffered, data, n);
+		buffered += n;
+		data += n;
+		left -= n;
+		if (buffered == WRITE_CHUNK) {
+			if (!Flush(WRITE_CHUNK)) {
+				throw Write_Exception(name);
+			}
+			buffered = 0;
+		}
+	}
+	frames_written += count;
+}
+void WavBlockWriter::Close() {
+	if (fd < 0) {
+		return;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t total = sizeof(head) + frames_written * head.blockAlign;
+	bool ok = true;
+	if (buffered > 0) {
+		// O_DIRECT only takes whole blocks; the padding is cut off below.
+		size_t bytes = buffered;
+		if (stats.direct_io) {
+			bytes = (buffered + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+			memset(buffer + buffered, 0, bytes - buffered);
+		}
+		struct iovec iov = { buffer, bytes };
+		ok = WriteAll(fd, &iov, 1);
+	}
+	if (ok && stats.direct_io) {
+		// The header is too small for O_DIRECT, finish through a buffered descriptor.
+		int buffered_fd = open(path.c_str(), O_WRONLY);
+		ok = buffered_fd >= 0;
+		close(fd);
+		fd = buffered_fd;
+	}
+	// Drops the padding and whatever was preallocated but not written.
+	ok = ok && ftruncate(fd, total) == 0;
+	fill_header(&head, head.numChannels, 16, head.sampleRate, frames_written);
+	ok = ok && pwrite(fd, &head, sizeof(head), 0) == (ssize_t)sizeof(head);
+	// Same order as WriteWavFile: data on disk, then rename, then the directory.
+	if (ok && (options.sync || options.atomic)) {
+		ok = fsync(fd) == 0;
+	}
+	if (fd >= 0) {
+		ok = close(fd) == 0 && ok;
+	}
+	fd = -1;
+	if (ok && options.atomic) {
+		ok = rename(path.c_str(), name.c_str()) == 0 && SyncParentDir(name);
+	}
+	std::vector<char>().swap(storage);
+	buffer = NULL;
+	if (!ok) {
+		unlink(path.c_str());
+		throw Write_Exception(name);
+	}
+	stats.bytes = total;
+	stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "WavExceptions.h"
+#include "wav_header.h"
+#include "wav_writer.h"
+
+// Reads interleaved 16-bit PCM from a WAV file block by block,
+// without loading the whole file like Wav does.
+class WavBlockReader {
+public:
+	WavBlockReader(const std::string& filename);
+	~WavBlockReader();
+
+	const wav_header_s& Header() const { return head; }
+	int Channels() const { return head.numChannels; }
+	int SampleRate() const { return head.sampleRate; }
+	size_t Frames() const { return frames_total; }
+	size_t Position() const { return position; }
+
+	// Reads up to 'frames' interleaved frames into 'dest'.
+	// Returns the number of frames read, 0 at the end of data.
+	size_t Read(short* dest, size_t frames);
+	void Seek(size_t frame);
+private:
+	FILE* f;
+	wav_header_s head;
+	size_t frames_total;
+	size_t position;
+};
+
+// Writes interleaved 16-bit PCM block by block. The header is written in the same
+// layout as Wav::MakeWavFile and its sizes are filled in by Close.
+// Takes the same WriteOptions as WriteWavFile: blocks are gathered into large chunks,
+// the file is preallocated for 'expected_frames' when that is known, and with 'atomic'
+// Close renames a temporary file into place; a writer destroyed without Close leaves
+// the destination untouched.
+class WavBlockWriter {
+public:
+	WavBlockWriter(const std::string& filename, int chan_count, int sample_rate,
+		const WriteOptions& options = WriteOptions(), size_t expected_frames = 0);
+	~WavBlockWriter();
+
+	size_t Frames() const { return frames_written; }
+	// Bytes written and time spent writing them, complete after Close.
+	const WriteStats& Stats() const { return stats; }
+
+	void Write(const short* frames, size_t count);
+	void Close();
+private:
+	static const size_t WRITE_CHUNK = 1 << 20;
+
+	bool Flush(size_t bytes);
+	// Closes without publishing anything.
+	void Discard();
+
+	int fd;
+	std::string name;
+	// Where the blocks go, a temporary file with 'atomic'.
+	std::string path;
+	WriteOptions options;
+	WriteStats stats;
+	wav_header_s head;
+	size_t frames_written;
+	// WRITE_CHUNK bytes inside 'storage', aligned for O_DIRECT.
+	std::vector<char> storage;
+	char* buffer;
+	size_t buffered;
+};
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "wav_writer.h"
+
+static const size_t DIRECT_CHUNK = 8 << 20;
+
+bool WriteAll(int fd, struct iovec* iov, int count)
+{
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		size_t left = (size_t)written;
+		while (count > 0 && left >= iov->iov_len) {
+			left -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + left;
+			iov->iov_len -= left;
+		}
+	}
+	return true;
+}
+
+// Copies header and data through an aligned buffer so every write is a whole number of blocks.
+// The padding after the last block is cut off with ftruncate.
+static bool WriteDirect(int fd, const wav_header_s& head, const char* data, size_t data_bytes)
+{
+	void* mem = NULL;
+	if (posix_memalign(&mem, DIRECT_ALIGN, DIRECT_CHUNK) != 0) {
+		return false;
+	}
+	char* buffer = (char*)mem;
+
+	size_t total = sizeof(head) + data_bytes;
+	bool ok = true;
+	for (size_t pos = 0; pos < total && ok; pos += DIRECT_CHUNK) {
+		size_t chunk = std::min(DIRECT_CHUNK, total - pos);
+		size_t filled = 0;
+		if (pos < sizeof(head)) {
+			filled = sizeof(head) - pos;
+			memcpy(buffer, (const char*)&head + pos, filled);
+		}
+		memcpy(buffer + filled, data + (pos + filled - sizeof(head)), chunk - filled);
+
+		size_t padded = (chunk + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+		memset(buffer + chunk, 0, padded - chunk);
+		struct iovec iov = { buffer, padded };
+		ok = WriteAll(fd, &iov, 1);
+	}
+	free(buffer);
+	return ok && ftruncate(fd, total) == 0;
+}
+
+bool Preallocate(int fd, size_t bytes)
+{
+	int err = posix_fallocate(fd, 0, bytes);
+	// Not every file system can preallocate, that only costs speed.
+	return err == 0 || err == EOPNOTSUPP || err == EINVAL;
+}
+
+int CreateTempFile(const std::string& filename, std::string& path)
+{
+	static std::atomic<unsigned> counter(0);
+	int fd = -1;
+	for (int attempt = 0; attempt < 100 && fd < 0; attempt++) {
+		path = filename + ".tmp" + std::to_string(getpid()) + "." + std::to_string(counter++);
+		fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd < 0 && errno != EEXIST) {
+			return -1;
+		}
+	}
+	struct stat st;
+	if (fd >= 0 && stat(filename.c_str(), &st) == 0) {
+		fchmod(fd, st.st_mode & 07777);
+	}
+	return fd;
+}
+
+bool SyncParentDir(const std::string& filename)
+{
+	size_t slash = filename.rfind('/');
+	std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+	int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = fsync(fd) == 0;
+	close(fd);
+	return ok;
+}
+
+WriteStats WriteWavFile(const std::string& filename, const wav_header_s& head,
+	const short* data, size_t samples, const WriteOptions& options)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	WriteStats stats;
+	size_t data_bytes = samples * sizeof(short);
+	stats.bytes = sizeof(head) + data_bytes;
+
+	std::string path = filename;
+	int fd;
+	if (options.atomic) {
+		// The temporary file must live in the same directory for rename to be atomic.
+		fd = CreateTempFile(filename, path);
+	}
+	else {
+		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	}
+	if (fd < 0) {
+		throw Write_Exception(filename);
+	}
+
+	if (options.direct_io) {
+		int direct_fd = open(path.c_str(), O_WRONLY | O_DIRECT);
+		if (direct_fd >= 0) {
+			close(fd);
+			fd = direct_fd;
+			stats.direct_io = true;
+		}
+	}
+
+	bool ok = true;
+	if (options.preallocate) {
+		ok = Preallocate(fd, stats.bytes);
+	}
+
+	if (ok && stats.direct_io) {
+		ok = WriteDirect(fd, head, (const char*)data, data_bytes);
+	}
+	else if (ok) {
+		struct iovec iov[2] = {
+			{ (void*)&head, sizeof(head) },
+			{ (void*)data, data_bytes }
+		};
+		ok = WriteAll(fd, iov, data_bytes ? 2 : 1);
+	}
+
+	// The data has to be on disk before the rename publishes it, or a power loss
+	// could leave an empty file under the final name.
+	if (ok && (options.sync || options.atomic)) {
+		ok = fsync(fd) == 0;
+	}
+	ok = close(fd) == 0 && ok;
+	if (ok && options.atomic) {
+		ok = rename(path.c_str(), filename.c_str()) == 0 && SyncParentDir(filename);
+	}
+	if (!ok) {
+		unlink(path.c_str());
+		throw Write_Exception(filename);
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
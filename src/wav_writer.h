@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+
+#include <sys/uio.h>
+
+#include "WavExceptions.h"
+#include "wav_header.h"
+
+struct WriteOptions {
+	// Reserve the final size with fallocate before writing.
+	bool preallocate = true;
+	// Bypass the page cache. Falls back to buffered writes where O_DIRECT isn't supported.
+	bool direct_io = false;
+	// Write to a temporary file next to the destination, fsync it, rename it into place
+	// and fsync the directory, so neither a crash nor a power loss leaves a truncated
+	// file under the final name.
+	bool atomic = true;
+	// fsync before closing. Implied by 'atomic'.
+	bool sync = false;
+};
+
+struct WriteStats {
+	size_t bytes = 0;
+	double seconds = 0.0;
+	bool direct_io = false;
+
+	double MegabytesPerSecond() const { return seconds > 0.0 ? bytes / seconds / 1e6 : 0.0; }
+};
+
+// O_DIRECT needs offsets, sizes and buffers aligned to the device block size.
+const size_t DIRECT_ALIGN = 4096;
+
+// Writes all 'count' iovecs, resuming after partial writes.
+bool WriteAll(int fd, struct iovec* iov, int count);
+// Reserves 'bytes' for 'fd' with fallocate. A file system that can't preallocate isn't an error.
+bool Preallocate(int fd, size_t bytes);
+// Creates a new file next to 'filename' for writing it atomically and stores its name in 'path'.
+// The file gets the destination's mode if that exists, otherwise 0666 minus the umask,
+// the same as a plain open() of the destination would give. Returns -1 on failure.
+int CreateTempFile(const std::string& filename, std::string& path);
+// Flushes the directory entry of 'filename', so a completed rename survives a power loss.
+bool SyncParentDir(const std::string& filename);
+
+// Writes 'head' followed by 'samples' interleaved 16-bit samples as one file.
+// Every write is checked and Write_Exception is thrown on failure; with 'atomic' set
+// the destination keeps its previous contents in that case.
+WriteStats WriteWavFile(const std::string& filename, const wav_header_s& head,
+	const short* data, size_t samples, const WriteOptions& options);
@@ -0,0 +1,51 @@
+// Renders the same synthetic piece at 44.1 kHz and 48 kHz and checks that the
+// 48 kHz copy finds its 44.1 kHz twin in the index, ahead of an unrelated piece.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "fingerprint.h"
+
+static const double PI = 3.14159265358979323846;
+
+// A sequence of 250 ms chords with random pitches, fully determined by 'seed'.
+static std::vector<short> Render(unsigned seed, int sample_rate, double seconds)
+{
+	const double note_seconds = 0.25;
+	size_t notes = (size_t)(seconds / note_seconds);
+	std::vector<double> freqs(notes * 3);
+	srand(seed);
+	for (size_t i = 0; i < freqs.size(); i++) {
+		freqs[i] = 100.0 + rand() % 4400;
+	}
+
+	std::vector<short> signal((size_t)(seconds * sample_rate));
+	for (size_t i = 0; i < signal.size(); i++) {
+		double t = (double)i / sample_rate;
+		size_t note = std::min(notes - 1, (size_t)(t / note_seconds));
+		double v = 0.0;
+		for (int k = 0; k < 3; k++) {
+			v += sin(2.0 * PI * freqs[note * 3 + k] * t);
+		}
+		signal[i] = (short)(8000.0 * v);
+	}
+	return signal;
+}
+
+int main() {
+	FingerprintIndex index;
+	index.Add("piece_44100", ComputeFingerprint(Render(1, 44100, 20.0), 44100));
+	index.Add("other_44100", ComputeFingerprint(Render(2, 44100, 20.0), 44100));
+
+	std::vector<FingerprintMatch> matches = index.Query(ComputeFingerprint(Render(1, 48000, 20.0), 48000), 2);
+	for (size_t i = 0; i < matches.size(); i++) {
+		printf("%s: similarity %.3f at %.2f s\n", matches[i].name.c_str(), matches[i].similarity, matches[i].offset_seconds);
+	}
+
+	bool ok = matches.size() == 2 && matches[0].name == "piece_44100" &&
+		matches[0].similarity >= 0.3 && matches[0].similarity > 5.0 * matches[1].similarity &&
+		std::fabs(matches[0].offset_seconds) < 0.1;
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
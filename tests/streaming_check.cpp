@@ -0,0 +1,95 @@
+// Runs the same op chains once with a roomy budget (in-memory) and once with a budget
+// that only fits block streaming, and checks that both outputs are byte-identical.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "job.h"
+#include "wav_core.h"
+
+static const double PI = 3.14159265358979323846;
+
+// Loud tones with bursts of noise and a silent stretch, so reverb normalization,
+// saturation and truncation all have something to do.
+static void MakeInput(const std::string& filename, int chan_count, int sample_rate, double seconds)
+{
+	size_t frames = (size_t)(seconds * sample_rate);
+	std::vector<short> data(frames * chan_count);
+	srand(7);
+	for (size_t i = 0; i < frames; i++) {
+		double t = (double)i / sample_rate;
+		for (int ch = 0; ch < chan_count; ch++) {
+			double v = 0.0;
+			if (t < seconds * 0.6 || t > seconds * 0.8) {
+				v = 20000.0 * sin(2.0 * PI * (220.0 + 110.0 * ch) * t) + (rand() % 8000 - 4000);
+			}
+			data[i * chan_count + ch] = (short)std::max(-32768.0, std::min(32767.0, v));
+		}
+	}
+	wav_header_s head;
+	fill_header(&head, chan_count, 16, sample_rate, frames);
+	FILE* f = fopen(filename.c_str(), "wb");
+	fwrite(&head, sizeof(head), 1, f);
+	fwrite(data.data(), sizeof(short), data.size(), f);
+	fclose(f);
+}
+
+static std::vector<char> ReadAll(const std::string& filename)
+{
+	std::vector<char> bytes;
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (f != NULL) {
+		char buffer[65536];
+		size_t got;
+		while ((got = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			bytes.insert(bytes.end(), buffer, buffer + got);
+		}
+		fclose(f);
+	}
+	return bytes;
+}
+
+int main() {
+	const char* inputs[] = { "streaming_check_stereo.wav", "streaming_check_mono.wav" };
+	MakeInput(inputs[0], 2, 44100, 30.0);
+	MakeInput(inputs[1], 1, 22050, 60.0);
+
+	std::vector<std::vector<std::string>> chains = {
+		{ "reverb:0.3:0.6" },
+		{ "reverb:0.3:0.6", "mono" },
+		{ "highpass:200", "reverb:0.1:0.9", "lowpass:3000" },
+		{ "reverb:0.2:0.8", "reverb:0.05:0.9", "mono", "highpass:100", "highpass:100.0" },
+		{ "lowpass:500", "mono" },
+		{ "mono", "reverb:0.25:0.7", "highpass:300" },
+		{ "reverb:1.5:0.5", "lowpass:8000" },
+	};
+
+	MemoryBudget memory((size_t)1 << 32);
+	JobScratch scratch;
+	int failures = 0;
+	for (const char* input : inputs) {
+		for (size_t c = 0; c < chains.size(); c++) {
+			bool mono_input = std::string(input) == inputs[1];
+			std::vector<std::string> ops;
+			for (size_t i = 0; i < chains[c].size(); i++) {
+				if (!(mono_input && chains[c][i] == "mono")) {
+					ops.push_back(chains[c][i]);
+				}
+			}
+
+			JobBudget roomy(memory, (size_t)1 << 30);
+			JobReport full = RunJob(input, "streaming_check_memory.wav", ops, roomy, scratch);
+			JobBudget tight(memory, (size_t)3 << 20);
+			JobReport streamed = RunJob(input, "streaming_check_stream.wav", ops, tight, scratch);
+
+			bool same = ReadAll("streaming_check_memory.wav") == ReadAll("streaming_check_stream.wav");
+			bool ok = same && full.mode == LOAD_IN_MEMORY && streamed.mode == LOAD_STREAMING;
+			printf("%s chain %zu: %s/%s %s\n", input, c, LoadModeName(full.mode), LoadModeName(streamed.mode),
+				ok ? "ok" : "FAILED");
+			failures += ok ? 0 : 1;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}